@@ -0,0 +1,564 @@
+#include "aot.h"
+#include "chip8.h"
+#include "instructions.h"
+#include "profile.h"
+
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define ROM_START 0x200
+
+struct aot
+{
+    chip8_t* chip;
+    const aot_program_t* program;
+    const aot_block_t* blocks[4096];    // by start pc, NULL where the interpreter runs
+    uint64_t* pages;                    // per program block, the 64-byte pages it was translated from
+};
+
+typedef struct
+{
+    const uint8_t* rom;
+    size_t size;
+    bool leader[4096];  // a block starts here
+    bool walked[4096];  // reached while discovering code
+    uint16_t work[4096 * 2 + 1]; // pcs left to walk, every walked pc pushes at most two
+    uint16_t starts[4096];
+    uint16_t lengths[4096];
+} walk_t;
+
+// registers a block reads or writes, loaded into locals on entry and stored on exit
+typedef struct
+{
+    uint16_t used;
+    uint16_t written;
+    bool i_used;
+    bool i_written;
+} regs_t;
+
+
+// the whole instruction at addr lies in the rom
+static bool in_rom(const walk_t* walk, uint32_t addr)
+{
+    return addr >= ROM_START && addr + 2 <= ROM_START + walk->size;
+}
+
+static uint16_t fetch(const walk_t* walk, uint16_t addr)
+{
+    return walk->rom[addr - ROM_START] << 8 | walk->rom[addr - ROM_START + 1];
+}
+
+/*
+    True when the instruction at addr ends a block, with the pcs it can
+    continue at that are known statically in targets. Memory writes end a
+    block so the program can't overwrite the rest of it while it runs.
+*/
+static bool ends_block(uint8_t op, uint16_t addr, uint16_t opcode, uint16_t* targets, uint8_t* count)
+{
+    const uint16_t next = addr + 2;
+    *count = 0;
+    switch (op)
+    {
+        case OP_JP:
+            targets[(*count)++] = opcode & 0xFFF;
+            return true;
+        case OP_CALL:
+            targets[(*count)++] = opcode & 0xFFF;
+            targets[(*count)++] = next;
+            return true;
+        case OP_RET:
+        case OP_JP_V0:
+            return true;
+        case OP_SE_VX_KK:
+        case OP_SNE_VX_KK:
+        case OP_SE_VX_VY:
+        case OP_SNE_VX_VY:
+        case OP_SKP:
+        case OP_SKNP:
+            targets[(*count)++] = next;
+            targets[(*count)++] = next + 2;
+            return true;
+        case OP_LD_VX_K:
+            targets[(*count)++] = addr;
+            targets[(*count)++] = next;
+            return true;
+        case OP_LD_B_VX:
+        case OP_LD_I_VX:
+        case OP_UNKNOWN:
+            targets[(*count)++] = next;
+            return true;
+        default:
+            return false;
+    }
+}
+
+// marks every block start reachable from 0x200 through jumps, calls and skips
+static void discover(walk_t* walk)
+{
+    uint16_t* work = walk->work;
+    uint32_t top = 0;
+    work[top++] = ROM_START;
+
+    while (top > 0)
+    {
+        uint16_t addr = work[--top];
+        if (!in_rom(walk, addr)) continue;
+        walk->leader[addr] = true;
+
+        while (in_rom(walk, addr))
+        {
+            if (walk->walked[addr]) {
+                // ran into code walked from somewhere else, which splits it here
+                walk->leader[addr] = true;
+                break;
+            }
+            walk->walked[addr] = true;
+
+            const uint16_t opcode = fetch(walk, addr);
+            uint16_t targets[2];
+            uint8_t count;
+            if (ends_block(decode_opcode(opcode), addr, opcode, targets, &count)) {
+                for (uint8_t n = 0; n < count; n++) work[top++] = targets[n];
+                break;
+            }
+            addr += 2;
+        }
+    }
+}
+
+
+static void skip_if(FILE* out, uint16_t next, const char* condition, ...)
+    __attribute__((format(printf, 3, 4)));
+
+static void skip_if(FILE* out, uint16_t next, const char* condition, ...)
+{
+    va_list args;
+    va_start(args, condition);
+    fprintf(out, "    next = ");
+    vfprintf(out, condition, args);
+    fprintf(out, " ? 0x%.3X : 0x%.3X;\n", next + 2, next);
+    va_end(args);
+}
+
+// writes the C for one instruction, true when it ends the block and has set next
+static bool emit_instruction(FILE* out, uint8_t op, uint16_t addr, uint16_t opcode, regs_t* regs)
+{
+    const uint8_t x = (opcode >> 8) & 0xF;
+    const uint8_t y = (opcode >> 4) & 0xF;
+    const uint8_t kk = opcode & 0xFF;
+    const uint16_t nnn = opcode & 0xFFF;
+    const uint16_t next = addr + 2;
+
+    #define READ(r)     (regs->used |= 1 << (r))
+    #define WRITE(r)    (regs->used |= 1 << (r), regs->written |= 1 << (r))
+    #define READ_I()    (regs->i_used = true)
+    #define WRITE_I()   (regs->i_used = regs->i_written = true)
+
+    switch (op)
+    {
+        case OP_CLS:
+            fprintf(out, "    memset(chip->display, 0, sizeof(chip->display));\n");
+            fprintf(out, "    chip->redraw = true;\n");
+            return false;
+        case OP_RET:
+            fprintf(out, "    next = chip->stack[chip->sp];\n");
+            fprintf(out, "    if (chip->sp > 0) chip->sp--;\n");
+            return true;
+        case OP_SYS:
+            return false;
+        case OP_JP:
+            fprintf(out, "    next = 0x%.3X;\n", nnn);
+            return true;
+        case OP_CALL:
+            fprintf(out, "    if (chip->sp < 11) chip->sp++;\n");
+            fprintf(out, "    chip->stack[chip->sp] = 0x%.3X;\n", next);
+            fprintf(out, "    next = 0x%.3X;\n", nnn);
+            return true;
+        case OP_SE_VX_KK:
+            READ(x);
+            skip_if(out, next, "v%X == 0x%.2X", x, kk);
+            return true;
+        case OP_SNE_VX_KK:
+            READ(x);
+            skip_if(out, next, "v%X != 0x%.2X", x, kk);
+            return true;
+        case OP_SE_VX_VY:
+            // the same register twice would be a self-comparison
+            if (x == y) {
+                skip_if(out, next, "true");
+            } else {
+                READ(x), READ(y);
+                skip_if(out, next, "v%X == v%X", x, y);
+            }
+            return true;
+        case OP_SNE_VX_VY:
+            if (x == y) {
+                skip_if(out, next, "false");
+            } else {
+                READ(x), READ(y);
+                skip_if(out, next, "v%X != v%X", x, y);
+            }
+            return true;
+        case OP_LD_VX_KK:
+            WRITE(x);
+            fprintf(out, "    v%X = 0x%.2X;\n", x, kk);
+            return false;
+        case OP_ADD_VX_KK:
+            WRITE(x);
+            fprintf(out, "    v%X += 0x%.2X;\n", x, kk);
+            return false;
+        case OP_LD_VX_VY:
+            READ(y), WRITE(x);
+            fprintf(out, "    v%X = v%X;\n", x, y);
+            return false;
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+            READ(y), WRITE(x);
+            fprintf(out, "    v%X %s= v%X;\n", x, op == OP_OR ? "|" : op == OP_AND ? "&" : "^", y);
+            return false;
+        case OP_ADD_VX_VY:
+            READ(y), WRITE(x), WRITE(0xF);
+            fprintf(out, "    { const uint16_t sum = v%X + v%X; v%X = sum; vF = sum > 0xFF; }\n", x, y, x);
+            return false;
+        case OP_SUB:
+            READ(y), WRITE(x), WRITE(0xF);
+            if (x == y) fprintf(out, "    v%X = 0; vF = 1;\n", x);
+            else fprintf(out, "    { const uint8_t flag = v%X >= v%X; v%X -= v%X; vF = flag; }\n", x, y, x, y);
+            return false;
+        case OP_SHR:
+            WRITE(x), WRITE(0xF);
+            fprintf(out, "    { const uint8_t flag = v%X & 0x01; v%X >>= 1; vF = flag; }\n", x, x);
+            return false;
+        case OP_SUBN:
+            READ(y), WRITE(x), WRITE(0xF);
+            if (x == y) fprintf(out, "    v%X = 0; vF = 1;\n", x);
+            else fprintf(out, "    { const uint8_t flag = v%X >= v%X; v%X = v%X - v%X; vF = flag; }\n", y, x, x, y, x);
+            return false;
+        case OP_SHL:
+            WRITE(x), WRITE(0xF);
+            fprintf(out, "    { const uint8_t flag = v%X >> 7; v%X <<= 1; vF = flag; }\n", x, x);
+            return false;
+        case OP_LD_I:
+            WRITE_I();
+            fprintf(out, "    i = 0x%.3X;\n", nnn);
+            return false;
+        case OP_JP_V0:
+            READ(0);
+            fprintf(out, "    next = 0x%.3X + v0;\n", nnn);
+            return true;
+        case OP_RND:
+            WRITE(x);
+            fprintf(out, "    v%X = random_byte(chip) & 0x%.2X;\n", x, kk);
+            return false;
+        case OP_DRW:
+            READ(x), READ(y), READ_I(), WRITE(0xF);
+            fprintf(out, "    vF = draw_sprite(chip, v%X, v%X, i, %u);\n", x, y, opcode & 0xF);
+            return false;
+        case OP_SKP:
+            READ(x);
+            fprintf(out, "    chip->keys_read |= 1 << (v%X & 0x0F);\n", x);
+            skip_if(out, next, "chip->keypad[v%X & 0x0F]", x);
+            return true;
+        case OP_SKNP:
+            READ(x);
+            fprintf(out, "    chip->keys_read |= 1 << (v%X & 0x0F);\n", x);
+            skip_if(out, next, "!chip->keypad[v%X & 0x0F]", x);
+            return true;
+        case OP_LD_VX_DT:
+            WRITE(x);
+            fprintf(out, "    v%X = chip->delay_timer;\n", x);
+            return false;
+        case OP_LD_VX_K:
+            // no key down runs it again, the block for addr
+            WRITE(x);
+            fprintf(out, "    next = 0x%.3X;\n", addr);
+            fprintf(out, "    for (uint8_t key = 0; key < 16; key++)\n");
+            fprintf(out, "    {\n");
+            fprintf(out, "        if (chip->keypad[key]) { v%X = key; chip->keys_read |= 1 << key; next = 0x%.3X; break; }\n", x, next);
+            fprintf(out, "    }\n");
+            return true;
+        case OP_LD_DT_VX:
+            READ(x);
+            fprintf(out, "    chip->delay_timer = v%X;\n", x);
+            return false;
+        case OP_LD_ST_VX:
+            READ(x);
+            fprintf(out, "    chip->sound_timer = v%X;\n", x);
+            return false;
+        case OP_ADD_I_VX:
+            READ(x), WRITE_I();
+            fprintf(out, "    i += v%X;\n", x);
+            return false;
+        case OP_LD_F_VX:
+            READ(x), WRITE_I();
+            fprintf(out, "    i = (v%X & 0x0F) * 5;\n", x);
+            return false;
+        case OP_LD_B_VX:
+            READ(x), READ_I();
+            fprintf(out, "    chip->memory[i & 0xFFF] = v%X / 100;\n", x);
+            fprintf(out, "    chip->memory[(i + 1) & 0xFFF] = v%X / 10 %% 10;\n", x);
+            fprintf(out, "    chip->memory[(i + 2) & 0xFFF] = v%X %% 10;\n", x);
+            fprintf(out, "    invalidate_decoded(chip, i, 3);\n");
+            fprintf(out, "    next = 0x%.3X;\n", next);
+            return true;
+        case OP_LD_I_VX:
+            READ_I();
+            for (uint8_t r = 0; r <= x; r++)
+            {
+                READ(r);
+                fprintf(out, "    chip->memory[(i + %u) & 0xFFF] = v%X;\n", r, r);
+            }
+            fprintf(out, "    invalidate_decoded(chip, i, %u);\n", x + 1);
+            fprintf(out, "    next = 0x%.3X;\n", next);
+            return true;
+        case OP_LD_VX_I:
+            READ_I();
+            for (uint8_t r = 0; r <= x; r++)
+            {
+                WRITE(r);
+                fprintf(out, "    v%X = chip->memory[(i + %u) & 0xFFF];\n", r, r);
+            }
+            return false;
+    }
+    return false;
+
+    #undef READ
+    #undef WRITE
+    #undef READ_I
+    #undef WRITE_I
+}
+
+/*
+    Writes the function for the block at start: instructions up to one that
+    ends a block, the next block start, an opcode the interpreter has to run
+    or the end of the rom. Returns the instructions it covers, 0 for none.
+*/
+static uint16_t emit_block(const walk_t* walk, uint16_t start, FILE* out)
+{
+    char* body = NULL;
+    size_t body_size = 0;
+    FILE* code = open_memstream(&body, &body_size);
+    if (!code) {
+        return 0;
+    }
+
+    regs_t regs = { 0 };
+    uint16_t length = 0;
+    uint16_t addr = start;
+    bool ended = false;
+    while (!ended && in_rom(walk, addr) && (addr == start || !walk->leader[addr]))
+    {
+        const uint16_t opcode = fetch(walk, addr);
+        const uint8_t op = decode_opcode(opcode);
+        if (op == OP_UNKNOWN) break;
+
+        fprintf(code, "    // %.3X: %.4X %s\n", addr, opcode, op_name(op));
+        ended = emit_instruction(code, op, addr, opcode, &regs);
+        length++;
+        addr += 2;
+    }
+    if (!ended) {
+        fprintf(code, "    next = 0x%.3X;\n", addr);
+    }
+    fclose(code);
+
+    if (length > 0) {
+        fprintf(out, "static uint16_t block_%.3X(chip8_t* chip)\n{\n", start);
+        for (uint8_t r = 0; r < 16; r++)
+        {
+            if (regs.used & 1 << r) fprintf(out, "    uint8_t v%X = chip->v[0x%X];\n", r, r);
+        }
+        if (regs.i_used) fprintf(out, "    uint16_t i = chip->i;\n");
+        fprintf(out, "    uint16_t next;\n\n%s\n", body);
+        for (uint8_t r = 0; r < 16; r++)
+        {
+            if (regs.written & 1 << r) fprintf(out, "    chip->v[0x%X] = v%X;\n", r, r);
+        }
+        if (regs.i_written) fprintf(out, "    chip->i = i;\n");
+        fprintf(out, "    return next;\n}\n\n");
+    }
+    free(body);
+    return length;
+}
+
+static void write_escaped(FILE* out, const char* text)
+{
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\') fputc('\\', out);
+        fputc(*text, out);
+    }
+}
+
+bool write_aot(const uint8_t* rom, size_t rom_size, const char* rom_name, const char* program, FILE* out)
+{
+    if (rom_size < 2 || rom_size > MAX_ROM_SIZE) {
+        fprintf(stderr, "%s: %zu bytes is not a rom\n", rom_name, rom_size);
+        return false;
+    }
+
+    walk_t* walk = calloc(1, sizeof(walk_t));
+    if (!walk) {
+        return false;
+    }
+    walk->rom = rom;
+    walk->size = rom_size;
+    discover(walk);
+
+    fprintf(out, "// %s translated by play-aotc, regenerate instead of editing\n\n", rom_name);
+    fprintf(out, "#include \"aot.h\"\n#include \"chip8.h\"\n#include \"instructions.h\"\n\n");
+    fprintf(out, "#include <stdbool.h>\n#include <stdint.h>\n#include <string.h>\n\n\n");
+
+    fprintf(out, "static const uint8_t rom[%zu] = {", rom_size);
+    for (size_t n = 0; n < rom_size; n++)
+    {
+        fprintf(out, "%s0x%.2X,", n % 12 ? " " : "\n    ", rom[n]);
+    }
+    fprintf(out, "\n};\n\n");
+
+    uint16_t* starts = walk->starts;
+    uint16_t* lengths = walk->lengths;
+    uint16_t count = 0;
+    uint32_t instructions = 0;
+    for (uint16_t addr = ROM_START; addr < 4096; addr++)
+    {
+        if (!walk->leader[addr]) continue;
+        const uint16_t length = emit_block(walk, addr, out);
+        if (length > 0) {
+            starts[count] = addr;
+            lengths[count++] = length;
+            instructions += length;
+        }
+    }
+
+    if (count > 0) {
+        fprintf(out, "static const aot_block_t blocks[%u] = {\n", count);
+        for (uint16_t n = 0; n < count; n++)
+        {
+            fprintf(out, "    { 0x%.3X, %u, block_%.3X },\n", starts[n], lengths[n], starts[n]);
+        }
+        fprintf(out, "};\n\n");
+    }
+    fprintf(out, "const aot_program_t %s = { \"", program);
+    write_escaped(out, rom_name);
+    fprintf(out, "\", rom, %zu, %s, %u };\n", rom_size, count ? "blocks" : "NULL", count);
+
+    fprintf(out, "\n// %u blocks, %u instructions\n", count, instructions);
+    free(walk);
+
+    if (ferror(out)) {
+        fprintf(stderr, "Failed to write translation of %s\n", rom_name);
+        return false;
+    }
+    return true;
+}
+
+
+static bool matches(const aot_t* aot, const aot_block_t* block)
+{
+    return memcmp(&aot->chip->memory[block->start], &aot->program->rom[block->start - ROM_START], block->length * 2) == 0;
+}
+
+// re-checks the blocks on pages against memory, enabling the ones that match and dropping the rest
+static void check_pages(aot_t* aot, uint64_t pages)
+{
+    for (uint16_t n = 0; n < aot->program->block_count; n++)
+    {
+        if (aot->pages[n] & pages) {
+            const aot_block_t* block = &aot->program->blocks[n];
+            aot->blocks[block->start] = matches(aot, block) ? block : NULL;
+        }
+    }
+}
+
+
+aot_t* init_aot(chip8_t* chip, const aot_program_t* program)
+{
+    if (chip->quirks != QUIRKS_MODERN) {
+        fprintf(stderr, "Translated code only runs the modern quirk profile, interpreting\n");
+        return NULL;
+    }
+    aot_t* aot = calloc(1, sizeof(aot_t));
+    if (!aot) {
+        return NULL;
+    }
+    aot->pages = calloc(program->block_count ? program->block_count : 1, sizeof(uint64_t));
+    if (!aot->pages) {
+        free(aot);
+        return NULL;
+    }
+    aot->chip = chip;
+    aot->program = program;
+
+    for (uint16_t n = 0; n < program->block_count; n++)
+    {
+        const aot_block_t* block = &program->blocks[n];
+        for (uint16_t a = block->start; a < block->start + block->length * 2; a += 64 - a % 64)
+        {
+            aot->pages[n] |= 1ULL << (a >> 6);
+        }
+    }
+
+    // a state loaded over the rom or another rom entirely leaves blocks to the interpreter
+    check_pages(aot, UINT64_MAX);
+    chip->written_pages = 0;
+    return aot;
+}
+
+
+uint32_t run_aot(aot_t* aot, uint32_t count)
+{
+    chip8_t* chip = aot->chip;
+    chip->idle = IDLE_NONE;
+    uint32_t ran = 0;
+
+    while (count > 0)
+    {
+        if (chip->written_pages) {
+            const uint64_t pages = chip->written_pages;
+            chip->written_pages = 0;
+            check_pages(aot, pages);
+        }
+
+        // an idle loop goes to the interpreter, which skips it and counts it once
+        if (idles_at(chip, chip->pc)) {
+            ran += run_instructions(chip, count);
+            break;
+        }
+
+        const aot_block_t* block = aot->blocks[chip->pc & 0xFFF];
+        if (block && block->length <= count) {
+            chip->pc = block->run(chip);
+            count -= block->length;
+            ran += block->length;
+        } else {
+            ran += run_instructions(chip, 1);
+            count--;
+        }
+    }
+    return ran;
+}
+
+
+uint32_t aot_valid_blocks(const aot_t* aot)
+{
+    uint32_t valid = 0;
+    for (uint16_t pc = 0; pc < 4096; pc++)
+    {
+        valid += aot->blocks[pc] != NULL;
+    }
+    return valid;
+}
+
+
+void close_aot(aot_t* aot)
+{
+    free(aot->pages);
+    free(aot);
+}
@@ -0,0 +1,53 @@
+#ifndef AOT_H
+#define AOT_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+/*
+    Ahead-of-time translation. write_aot() walks a rom from 0x200 and writes
+    a C file with one function per basic block reachable through jumps,
+    calls and skips, plus an aot_program_t describing them. Linked into a
+    runner, run_aot() executes those functions wherever memory still holds
+    the bytes they were translated from, and the interpreter everywhere
+    else: indirect targets nothing jumped to directly, code outside the rom
+    and code the program has overwritten.
+*/
+typedef struct
+{
+    uint16_t start;     // pc of the first instruction
+    uint16_t length;    // instructions executed by one call
+    uint16_t (*run)(chip8_t* chip); // returns the next pc
+} aot_block_t;
+
+typedef struct
+{
+    const char* rom_name;
+    const uint8_t* rom;     // image the blocks were translated from, loaded at 0x200
+    uint16_t rom_size;
+    const aot_block_t* blocks;
+    uint16_t block_count;
+} aot_program_t;
+
+typedef struct aot aot_t;
+
+// translates rom into C defining program as an aot_program_t, false and stderr on failure
+bool write_aot(const uint8_t* rom, size_t rom_size, const char* rom_name, const char* program, FILE* out);
+
+// NULL when chip has a quirk profile other than QUIRKS_MODERN
+aot_t* init_aot(chip8_t* chip, const aot_program_t* program);
+
+// runs count instructions like run_instructions(), returning how many ran past an idle loop
+uint32_t run_aot(aot_t* aot, uint32_t count);
+
+// blocks whose bytes still match memory
+uint32_t aot_valid_blocks(const aot_t* aot);
+
+void close_aot(aot_t* aot);
+
+#endif
@@ -0,0 +1,69 @@
+#include "aot.h"
+#include "chip8.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+    Translates a rom to C ahead of time, see aot.h. make aot runs it and
+    links the result into play-aot.
+
+    usage: play-aotc [--name SYMBOL] [--output FILE] rom
+
+    --name is the aot_program_t the file defines (aot_program by default),
+    the C goes to stdout unless --output is given.
+*/
+
+static void usage(const char* exe)
+{
+    fprintf(stderr, "usage: %s [--name SYMBOL] [--output FILE] rom\n", exe);
+}
+
+int main( int argc, char* args[] )
+{
+    const char* name = "aot_program";
+    const char* output = NULL;
+    const char* rom_name = NULL;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(args[a], "--name") == 0 && a + 1 < argc) {
+            name = args[++a];
+        } else if (strcmp(args[a], "--output") == 0 && a + 1 < argc) {
+            output = args[++a];
+        } else if (args[a][0] == '-' || rom_name) {
+            usage(args[0]);
+            return 1;
+        } else {
+            rom_name = args[a];
+        }
+    }
+    if (!rom_name) {
+        usage(args[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(rom_name, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open rom %s\n", rom_name);
+        return 1;
+    }
+    uint8_t rom[MAX_ROM_SIZE + 1];
+    const size_t rom_size = fread(rom, 1, sizeof(rom), file);
+    fclose(file);
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Failed to create %s\n", output);
+        return 1;
+    }
+    const bool ok = write_aot(rom, rom_size, rom_name, name, out);
+    if (output && fclose(out) != 0) {
+        return 1;
+    }
+    return ok ? 0 : 1;
+}
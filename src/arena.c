@@ -0,0 +1,138 @@
+#include "arena.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+
+#define ALIGN 64
+
+// default chunk of thread_arena(), a few hundred forks or a dozen machines
+#define THREAD_CHUNK (256 << 10)
+
+typedef struct chunk
+{
+    struct chunk* next;
+    size_t size;        // bytes of data
+    size_t used;
+    _Alignas(ALIGN) uint8_t data[];
+} chunk_t;
+
+struct arena
+{
+    chunk_t* chunks;    // the one allocations come from first
+    size_t chunk_size;
+    size_t used;
+};
+
+static uint64_t resets;
+
+
+static chunk_t* new_chunk(size_t size)
+{
+    chunk_t* chunk = aligned_alloc(ALIGN, (sizeof(chunk_t) + size + ALIGN - 1) / ALIGN * ALIGN);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    return chunk;
+}
+
+
+arena_t* init_arena(size_t chunk_size)
+{
+    arena_t* arena = calloc(1, sizeof(arena_t));
+    if (!arena) {
+        return NULL;
+    }
+    arena->chunk_size = chunk_size > ALIGN ? chunk_size : ALIGN;
+    return arena;
+}
+
+void* arena_alloc(arena_t* arena, size_t size)
+{
+    size = (size + ALIGN - 1) / ALIGN * ALIGN;
+    chunk_t* chunk = arena->chunks;
+    if (!chunk || chunk->size - chunk->used < size) {
+        chunk = new_chunk(size > arena->chunk_size ? size : arena->chunk_size);
+        if (!chunk) {
+            fprintf(stderr, "Arena out of memory\n");
+            return NULL;
+        }
+        chunk->next = arena->chunks;
+        arena->chunks = chunk;
+    }
+    void* p = &chunk->data[chunk->used];
+    chunk->used += size;
+    arena->used += size;
+    return p;
+}
+
+void reset_arena(arena_t* arena)
+{
+    // the newest chunk stays for reuse
+    chunk_t* keep = arena->chunks;
+    if (keep) {
+        for (chunk_t* chunk = keep->next; chunk; )
+        {
+            chunk_t* next = chunk->next;
+            free(chunk);
+            chunk = next;
+        }
+        keep->next = NULL;
+        keep->used = 0;
+    }
+    arena->used = 0;
+    __atomic_fetch_add(&resets, 1, __ATOMIC_RELEASE);
+}
+
+size_t arena_used(const arena_t* arena)
+{
+    return arena->used;
+}
+
+void close_arena(arena_t* arena)
+{
+    for (chunk_t* chunk = arena->chunks; chunk; )
+    {
+        chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    free(arena);
+    __atomic_fetch_add(&resets, 1, __ATOMIC_RELEASE);
+}
+
+uint64_t arena_resets()
+{
+    return __atomic_load_n(&resets, __ATOMIC_ACQUIRE);
+}
+
+
+static pthread_key_t thread_key;
+static pthread_once_t thread_once = PTHREAD_ONCE_INIT;
+
+static void close_thread_arena(void* arena)
+{
+    close_arena(arena);
+}
+
+static void init_thread_key()
+{
+    pthread_key_create(&thread_key, close_thread_arena);
+}
+
+arena_t* thread_arena()
+{
+    pthread_once(&thread_once, init_thread_key);
+    arena_t* arena = pthread_getspecific(thread_key);
+    if (!arena) {
+        arena = init_arena(THREAD_CHUNK);
+        pthread_setspecific(thread_key, arena);
+    }
+    return arena;
+}
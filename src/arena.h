@@ -0,0 +1,35 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+    Bump allocator for short-lived machines and forks. Memory comes from
+    chunks of at least the size given to init_arena(), allocations are never
+    freed one by one: reset_arena() drops everything at once and keeps one
+    chunk for reuse. Not thread safe, each thread uses its own arena.
+*/
+typedef struct arena arena_t;
+
+arena_t* init_arena(size_t chunk_size);
+
+// size bytes aligned to 64, contents undefined
+void* arena_alloc(arena_t* arena, size_t size);
+
+// frees every allocation made since init_arena() or the last reset
+void reset_arena(arena_t* arena);
+
+// bytes handed out since the last reset
+size_t arena_used(const arena_t* arena);
+
+void close_arena(arena_t* arena);
+
+// the calling thread's arena, created on first use and closed when the thread exits
+arena_t* thread_arena();
+
+// resets of any arena so far, pointers into arenas from before a change may have been reused
+uint64_t arena_resets();
+
+#endif
@@ -0,0 +1,136 @@
+#include "audio.h"
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// peak of the square wave, a quarter of full scale
+#define AMPLITUDE 8192
+
+struct audio
+{
+    // emulator thread
+    _Alignas(64) uint32_t head;     // events queued, published with release
+    bool queued;                    // tone the last queued event asks for
+
+    // audio thread
+    _Alignas(64) uint32_t tail;     // events applied, published with release
+    bool playing;
+    uint32_t phase;                 // position in the tone period, a full turn is 2^32
+    uint32_t step;                  // phase advance per sample
+
+    // written by the emulator thread at head, read by the audio thread at tail
+    _Alignas(64) bool events[AUDIO_EVENTS];
+};
+
+
+audio_t* init_audio(uint32_t rate)
+{
+    if (rate == 0) {
+        fprintf(stderr, "Audio needs a sample rate\n");
+        return NULL;
+    }
+    audio_t* audio = aligned_alloc(64, sizeof(audio_t));
+    if (!audio) {
+        return NULL;
+    }
+    memset(audio, 0, sizeof(audio_t));
+    audio->step = ((uint64_t)AUDIO_TONE << 32) / rate;
+    return audio;
+}
+
+void audio_frame(audio_t* audio, const chip8_t* chip)
+{
+    const bool on = chip->sound_timer > 0;
+    if (on == audio->queued) return;
+
+    const uint32_t head = audio->head;
+    // full: nothing is lost, queued still differs so the next frame tries again
+    if (head - __atomic_load_n(&audio->tail, __ATOMIC_ACQUIRE) == AUDIO_EVENTS) return;
+
+    audio->events[head & (AUDIO_EVENTS - 1)] = on;
+    __atomic_store_n(&audio->head, head + 1, __ATOMIC_RELEASE);
+    audio->queued = on;
+}
+
+bool audio_on(const audio_t* audio)
+{
+    return audio->queued;
+}
+
+void render_audio(audio_t* audio, int16_t* out, uint32_t count)
+{
+    uint32_t tail = audio->tail;
+    const uint32_t head = __atomic_load_n(&audio->head, __ATOMIC_ACQUIRE);
+
+    bool heard = audio->playing;
+    for (; tail != head; tail++)
+    {
+        audio->playing = audio->events[tail & (AUDIO_EVENTS - 1)];
+        heard |= audio->playing;
+    }
+    __atomic_store_n(&audio->tail, tail, __ATOMIC_RELEASE);
+
+    if (!heard) {
+        // the next beep starts at the beginning of a period
+        audio->phase = 0;
+        memset(out, 0, count * sizeof(int16_t));
+        return;
+    }
+    for (uint32_t n = 0; n < count; n++)
+    {
+        out[n] = audio->phase < 0x80000000u ? AMPLITUDE : -AMPLITUDE;
+        audio->phase += audio->step;
+    }
+}
+
+void close_audio(audio_t* audio)
+{
+    free(audio);
+}
+
+
+static void put16(uint8_t** p, uint16_t w)
+{
+    *(*p)++ = w;
+    *(*p)++ = w >> 8;
+}
+
+static void put32(uint8_t** p, uint32_t d)
+{
+    put16(p, d);
+    put16(p, d >> 16);
+}
+
+bool write_wav_header(FILE* file, uint32_t rate, uint32_t samples)
+{
+    uint8_t header[44];
+    uint8_t* p = header;
+    const uint32_t bytes = samples * sizeof(int16_t);
+
+    memcpy(p, "RIFF", 4); p += 4;
+    put32(&p, 36 + bytes);
+    memcpy(p, "WAVE", 4); p += 4;
+
+    memcpy(p, "fmt ", 4); p += 4;
+    put32(&p, 16);
+    put16(&p, 1);                       // PCM
+    put16(&p, 1);                       // mono
+    put32(&p, rate);
+    put32(&p, rate * sizeof(int16_t));  // bytes per second
+    put16(&p, sizeof(int16_t));         // bytes per sample
+    put16(&p, 16);                      // bits per sample
+
+    memcpy(p, "data", 4); p += 4;
+    put32(&p, bytes);
+
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+        fprintf(stderr, "Failed to write WAV header\n");
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,45 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+#define AUDIO_RATE 48000    // samples per second
+#define AUDIO_TONE 440      // Hz, the beeper's square wave
+#define AUDIO_EVENTS 256    // tone changes the ring holds, a power of two
+
+/*
+    The beeper. The emulator thread calls audio_frame() once per frame and
+    it queues a tone on or off event whenever sound_timer crosses zero; the
+    audio thread drains them in render_audio(). The queue is a single
+    producer, single consumer ring with head and tail on their own cache
+    lines, so neither side ever takes a lock or waits on the other. A full
+    ring drops nothing, the change is retried on the next frame.
+*/
+typedef struct audio audio_t;
+
+audio_t* init_audio(uint32_t rate);
+
+// emulator thread: queues a change of tone, call after the timers tick
+void audio_frame(audio_t* audio, const chip8_t* chip);
+
+// true while the last queued event turned the tone on
+bool audio_on(const audio_t* audio);
+
+/*
+    Audio thread: fills out with count signed 16-bit mono samples after
+    applying every queued event. A beep shorter than the buffer, as turbo
+    mode makes them, still sounds for the whole buffer.
+*/
+void render_audio(audio_t* audio, int16_t* out, uint32_t count);
+
+void close_audio(audio_t* audio);
+
+// 16-bit mono WAV header for samples samples, write it again once they're known
+bool write_wav_header(FILE* file, uint32_t rate, uint32_t samples);
+
+#endif
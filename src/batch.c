@@ -0,0 +1,329 @@
+#include "batch.h"
+#include "chip8.h"
+#include "instructions.h"
+#include "roms.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+/*
+    Lane values are held in 16 bits, V registers and timers included, so one
+    pc mask applies to all of them without narrowing. 8-bit results are
+    masked back to 0xFF. Vectors are one hardware register wide: GCC lowers
+    comparisons on anything wider one element at a time.
+*/
+#ifdef __AVX2__
+#define VECTOR_BYTES 32
+#else
+#define VECTOR_BYTES 16
+#endif
+#define VECTOR_LANES (VECTOR_BYTES / 2)
+#define CHUNKS (LANES / VECTOR_LANES)
+
+typedef uint16_t u16v __attribute__((vector_size(VECTOR_BYTES), may_alias));
+typedef int16_t  m16v __attribute__((vector_size(VECTOR_BYTES), may_alias));
+
+// chunk c of a lane array as a vector
+#define V(array, c)  (*(u16v*)&(array)[(c) * VECTOR_LANES])
+
+// lanes set in mask take a, the others keep b
+#define BLEND(mask, a, b)  (((a) & (u16v)(mask)) | ((b) & ~(u16v)(mask)))
+
+struct batch
+{
+    // lane vectors, only valid inside run_batch()
+    _Alignas(64) uint16_t v[16][LANES];
+    _Alignas(64) uint16_t i[LANES];
+    _Alignas(64) uint16_t pc[LANES];
+    _Alignas(64) uint16_t delay_timer[LANES];
+    _Alignas(64) uint16_t sound_timer[LANES];
+
+    chip8_t* lanes[LANES];
+    uint32_t count;
+};
+
+
+static void load_lane(batch_t* b, uint32_t l)
+{
+    const chip8_t* chip = b->lanes[l];
+    for (uint8_t r = 0; r < 16; r++) b->v[r][l] = chip->v[r];
+    b->i[l] = chip->i;
+    b->pc[l] = chip->pc;
+    b->delay_timer[l] = chip->delay_timer;
+    b->sound_timer[l] = chip->sound_timer;
+}
+
+static void store_lane(batch_t* b, uint32_t l)
+{
+    chip8_t* chip = b->lanes[l];
+    for (uint8_t r = 0; r < 16; r++) chip->v[r] = b->v[r][l];
+    chip->i = b->i[l];
+    chip->pc = b->pc[l];
+    chip->delay_timer = b->delay_timer[l];
+    chip->sound_timer = b->sound_timer[l];
+}
+
+static uint16_t fetch(const chip8_t* chip, uint16_t pc)
+{
+    return chip->memory[pc] << 8 | chip->memory[(pc + 1) & 0xFFF];
+}
+
+// applies one decoded instruction to the lanes of chunk c set in mask, false if it has no vector form
+static bool step_chunk(batch_t* b, uint32_t c, m16v mask, op_t op, uint16_t opcode)
+{
+    const uint8_t x = (opcode >> 8) & 0x0F;
+    const uint8_t y = (opcode >> 4) & 0x0F;
+    const uint8_t kk = opcode & 0xFF;
+    const uint16_t nnn = opcode & 0x0FFF;
+
+    const u16v vx = V(b->v[x], c);
+    const u16v vy = V(b->v[y], c);
+    const u16v vf = V(b->v[0xF], c);
+    const u16v i = V(b->i, c);
+    u16v next = (V(b->pc, c) & 0xFFF) + 2;
+    m16v skip = {0};
+
+    switch (op)
+    {
+        case OP_SYS:
+            break;
+        case OP_JP:
+            next = (u16v){0} + nnn;
+            break;
+        case OP_SE_VX_KK:
+            skip = vx == kk;
+            break;
+        case OP_SNE_VX_KK:
+            skip = vx != kk;
+            break;
+        case OP_SE_VX_VY:
+            skip = vx == vy;
+            break;
+        case OP_SNE_VX_VY:
+            skip = vx != vy;
+            break;
+        case OP_LD_VX_KK:
+            V(b->v[x], c) = BLEND(mask, (u16v){0} + kk, vx);
+            break;
+        case OP_ADD_VX_KK:
+            V(b->v[x], c) = BLEND(mask, (vx + kk) & 0xFF, vx);
+            break;
+        case OP_LD_VX_VY:
+            V(b->v[x], c) = BLEND(mask, vy, vx);
+            break;
+        case OP_OR:
+            V(b->v[x], c) = BLEND(mask, vx | vy, vx);
+            break;
+        case OP_AND:
+            V(b->v[x], c) = BLEND(mask, vx & vy, vx);
+            break;
+        case OP_XOR:
+            V(b->v[x], c) = BLEND(mask, vx ^ vy, vx);
+            break;
+        case OP_ADD_VX_VY:
+        {
+            const u16v sum = vx + vy;
+            V(b->v[x], c) = BLEND(mask, sum & 0xFF, vx);
+            V(b->v[0xF], c) = BLEND(mask, sum >> 8, vf);
+            break;
+        }
+        case OP_SUB:
+        {
+            // values fit in 15 bits, so signed compares work on plain SSE2
+            const u16v not_borrow = (u16v)((m16v)vx >= (m16v)vy) & 1;
+            V(b->v[x], c) = BLEND(mask, (vx - vy) & 0xFF, vx);
+            V(b->v[0xF], c) = BLEND(mask, not_borrow, vf);
+            break;
+        }
+        case OP_SUBN:
+        {
+            const u16v not_borrow = (u16v)((m16v)vy >= (m16v)vx) & 1;
+            V(b->v[x], c) = BLEND(mask, (vy - vx) & 0xFF, vx);
+            V(b->v[0xF], c) = BLEND(mask, not_borrow, vf);
+            break;
+        }
+        case OP_SHR:
+            V(b->v[x], c) = BLEND(mask, vx >> 1, vx);
+            V(b->v[0xF], c) = BLEND(mask, vx & 1, vf);
+            break;
+        case OP_SHL:
+            V(b->v[x], c) = BLEND(mask, (vx << 1) & 0xFF, vx);
+            V(b->v[0xF], c) = BLEND(mask, vx >> 7, vf);
+            break;
+        case OP_LD_I:
+            V(b->i, c) = BLEND(mask, (u16v){0} + nnn, i);
+            break;
+        case OP_ADD_I_VX:
+            V(b->i, c) = BLEND(mask, i + vx, i);
+            break;
+        case OP_LD_F_VX:
+            V(b->i, c) = BLEND(mask, (vx & 0x0F) * 5, i);
+            break;
+        case OP_LD_VX_DT:
+            V(b->v[x], c) = BLEND(mask, V(b->delay_timer, c), vx);
+            break;
+        case OP_LD_DT_VX:
+            V(b->delay_timer, c) = BLEND(mask, vx, V(b->delay_timer, c));
+            break;
+        case OP_LD_ST_VX:
+            V(b->sound_timer, c) = BLEND(mask, vx, V(b->sound_timer, c));
+            break;
+        default:
+            return false;
+    }
+
+    next += (u16v)skip & 2;
+    V(b->pc, c) = BLEND(mask, next, V(b->pc, c));
+    return true;
+}
+
+
+/*
+    Runs at most 0xFFFF instructions per lane. Each step picks the lowest pc
+    among lanes with budget left, so lanes that branched apart re-converge
+    as soon as the ones behind reach the same address.
+*/
+static void run_lockstep(batch_t* b, uint16_t count)
+{
+    // lanes past b->count never run
+    _Alignas(64) uint16_t remaining[LANES] = {0};
+    for (uint32_t l = 0; l < b->count; l++) remaining[l] = count;
+
+    // union of pages any lane wrote, opcodes there may differ between lanes
+    uint64_t written = 0;
+    for (uint32_t l = 0; l < b->count; l++) written |= b->lanes[l]->written_pages;
+
+    for (;;)
+    {
+        // lowest pc among lanes with budget left, finished lanes read as 0xFFFF
+        uint16_t group_pc = 0xFFFF;
+        for (uint32_t l = 0; l < LANES; l++)
+        {
+            const uint16_t key = remaining[l] ? b->pc[l] & 0xFFF : 0xFFFF;
+            group_pc = key < group_pc ? key : group_pc;
+        }
+        if (group_pc == 0xFFFF) break;
+
+        // lanes taking this step, 0xFFFF or 0
+        _Alignas(64) uint16_t active[LANES];
+        for (uint32_t c = 0; c < CHUNKS; c++)
+        {
+            V(active, c) = (u16v)(((V(b->pc, c) & 0xFFF) == group_pc) & (V(remaining, c) != 0));
+        }
+
+        // unwritten pages hold the same bytes in every lane
+        uint32_t first = 0;
+        const bool modified = (written >> (group_pc >> 6)) & 3;
+        if (modified) {
+            while (!active[first]) first++;
+        }
+        const uint16_t opcode = fetch(b->lanes[first], group_pc);
+
+        if (modified) {
+            // self-modified code, lanes with a different opcode wait for a later step
+            for (uint32_t l = first + 1; l < b->count; l++)
+            {
+                if (active[l] && fetch(b->lanes[l], group_pc) != opcode) active[l] = 0;
+            }
+        }
+
+        const op_t op = decode_opcode(opcode);
+        bool vector = true;
+        for (uint32_t c = 0; c < CHUNKS && vector; c++)
+        {
+            vector = step_chunk(b, c, (m16v)V(active, c), op, opcode);
+        }
+
+        if (!vector) {
+            // no vector form, step each lane through the interpreter
+            for (uint32_t l = first; l < b->count; l++)
+            {
+                if (!active[l]) continue;
+                store_lane(b, l);
+                run_instructions(b->lanes[l], 1);
+                load_lane(b, l);
+                written |= b->lanes[l]->written_pages;
+            }
+        }
+
+        // active lanes are 0xFFFF, so this takes one from each lane that ran
+        for (uint32_t c = 0; c < CHUNKS; c++)
+        {
+            V(remaining, c) += V(active, c);
+        }
+    }
+}
+
+
+batch_t* init_batch(const char* rom_name, uint32_t lanes)
+{
+    if (lanes == 0 || lanes > LANES) {
+        fprintf(stderr, "Lockstep batches hold 1 to %d lanes\n", LANES);
+        return NULL;
+    }
+
+    batch_t* b = aligned_alloc(64, sizeof(batch_t));
+    if (!b) {
+        fprintf(stderr, "Not enough memory for %u lanes\n", lanes);
+        return NULL;
+    }
+    memset(b, 0, sizeof(batch_t));
+    b->count = lanes;
+
+    // looked up once, every lane starts from the same image
+    const rom_t* rom = load_rom(shared_roms(), rom_name);
+    if (!rom) {
+        close_batch(b);
+        return NULL;
+    }
+    for (uint32_t l = 0; l < lanes; l++)
+    {
+        b->lanes[l] = init_chip_from_memory(rom->data, rom->size);
+        if (!b->lanes[l]) {
+            close_batch(b);
+            return NULL;
+        }
+        b->lanes[l]->rng += l;
+        if (b->lanes[l]->rng == 0) b->lanes[l]->rng = 1;
+    }
+    return b;
+}
+
+chip8_t* batch_lane(batch_t* batch, uint32_t lane)
+{
+    return batch->lanes[lane];
+}
+
+void run_batch(batch_t* batch, uint32_t count)
+{
+    for (uint32_t l = 0; l < batch->count; l++) load_lane(batch, l);
+    while (count > 0)
+    {
+        const uint16_t step = count > 0xFFFF ? 0xFFFF : count;
+        run_lockstep(batch, step);
+        count -= step;
+    }
+    for (uint32_t l = 0; l < batch->count; l++) store_lane(batch, l);
+}
+
+void run_batch_frame(batch_t* batch, uint32_t ipf)
+{
+    run_batch(batch, ipf);
+    for (uint32_t l = 0; l < batch->count; l++)
+    {
+        tick_timers(batch->lanes[l]);
+    }
+}
+
+void close_batch(batch_t* batch)
+{
+    for (uint32_t l = 0; l < batch->count; l++)
+    {
+        free(batch->lanes[l]);
+    }
+    free(batch);
+}
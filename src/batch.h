@@ -0,0 +1,38 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+#define LANES 32
+
+
+/*
+    Lockstep interpreter for up to LANES machines running the same rom.
+    V, I, PC and the timers live in lane vectors while running, lanes sharing
+    the lowest pc execute together and the others are masked off until they
+    catch up. Opcodes without a vector form (calls, draws, memory and key
+    ops, Cxkk) run through run_instructions() per lane.
+
+    Build with -mavx2 (or -march=native) to step 16 lanes per instruction
+    instead of the 8 that fit an SSE register.
+*/
+typedef struct batch batch_t;
+
+// lane n starts with rng seed base + n, like init_pool()
+batch_t* init_batch(const char* rom_name, uint32_t lanes);
+
+// the lane's machine, current between run_batch() calls
+chip8_t* batch_lane(batch_t* batch, uint32_t lane);
+
+// runs count instructions on every lane
+void run_batch(batch_t* batch, uint32_t count);
+
+// one 60 Hz frame on every lane
+void run_batch_frame(batch_t* batch, uint32_t ipf);
+
+void close_batch(batch_t* batch);
+
+#endif
@@ -0,0 +1,268 @@
+#include "chip8.h"
+#include "instructions.h"
+#include "jit.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+
+/*
+    Benchmarks, printed as one JSON document on stdout so builds can be
+    compared by script. Built with -O2 by make bench.
+
+    usage: play-bench [--repeats N] [--instructions N] [--frames N] [--ipf N] [--jit] [rom ...]
+
+    Every opcode family first runs as a microbenchmark: a short loop of that
+    family's instructions closed by a JP, --instructions long. Each rom then
+    runs --frames frames of --ipf instructions, and its rates count the
+    instructions that really ran, not the idle loops skipped. Every
+    measurement is repeated --repeats times and reported as mean, standard
+    deviation, min and max.
+*/
+
+#define MAX_REPEATS 64
+
+typedef struct
+{
+    const char* name;
+    uint8_t program[64];
+    uint8_t size;
+} micro_t;
+
+// each loop ends with 0x12, 0x00 (JP 200) unless noted
+static const micro_t micros[] = {
+    { "ld_add_kk", {
+        0x60, 0x01, 0x71, 0x02, 0x62, 0x03, 0x73, 0x04,
+        0x64, 0x05, 0x75, 0x06, 0x66, 0x07, 0x77, 0x08,
+        0x12, 0x00 }, 18 },
+    { "alu_8xyn", {
+        0x80, 0x10, 0x81, 0x21, 0x82, 0x32, 0x83, 0x43,
+        0x84, 0x54, 0x85, 0x65, 0x86, 0x76, 0x87, 0x07,
+        0x88, 0x1E, 0x89, 0x24, 0x8A, 0x35, 0x8B, 0x46,
+        0x12, 0x00 }, 26 },
+    { "skip", {
+        0x30, 0x01, 0x41, 0x00, 0x52, 0x30, 0x93, 0x40,
+        0x34, 0x00, 0x00, 0x00, 0xE5, 0x9E, 0xE6, 0xA1,
+        0x00, 0x00, 0x12, 0x00 }, 20 },
+    { "draw_dxyn", {
+        0xA0, 0x00, 0xD0, 0x15, 0x70, 0x03, 0x71, 0x01,
+        0xD0, 0x15, 0x70, 0x05, 0xD0, 0x1F, 0x71, 0x02,
+        0x12, 0x02 }, 18 },
+    { "bcd_fx33", {
+        0xA8, 0x00, 0xF0, 0x33, 0x70, 0x07, 0xF0, 0x33,
+        0x70, 0x0B, 0xF0, 0x33, 0x12, 0x02 }, 14 },
+    { "store_fx55", {
+        0xA8, 0x00, 0xFF, 0x55, 0xF7, 0x55, 0xF3, 0x55,
+        0x70, 0x01, 0x12, 0x02 }, 12 },
+    { "load_fx65", {
+        0xA8, 0x00, 0xFF, 0x65, 0xF7, 0x65, 0xF3, 0x65,
+        0x70, 0x01, 0x12, 0x02 }, 12 },
+    { "call_ret", {
+        0x22, 0x06, 0x22, 0x06, 0x12, 0x00, 0x70, 0x01,
+        0x00, 0xEE }, 10 },
+    { "timers_i", {
+        0xF0, 0x15, 0xF1, 0x07, 0xF2, 0x18, 0xF0, 0x1E,
+        0xF1, 0x29, 0xA3, 0x00, 0x12, 0x00 }, 14 },
+};
+
+typedef struct
+{
+    double mean;
+    double stddev;
+    double min;
+    double max;
+} stats_t;
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static stats_t summarize(const double* samples, uint32_t count)
+{
+    stats_t s = { 0, 0, samples[0], samples[0] };
+    for (uint32_t n = 0; n < count; n++)
+    {
+        s.mean += samples[n];
+        s.min = samples[n] < s.min ? samples[n] : s.min;
+        s.max = samples[n] > s.max ? samples[n] : s.max;
+    }
+    s.mean /= count;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        s.stddev += (samples[n] - s.mean) * (samples[n] - s.mean);
+    }
+    s.stddev = count > 1 ? sqrt(s.stddev / (count - 1)) : 0;
+    return s;
+}
+
+static void print_stats(const char* name, const double* samples, uint32_t count, bool last)
+{
+    const stats_t s = summarize(samples, count);
+    printf("        \"%s\": { \"mean\": %.6g, \"stddev\": %.6g, \"min\": %.6g, \"max\": %.6g }%s\n",
+        name, s.mean, s.stddev, s.min, s.max, last ? "" : ",");
+}
+
+/*
+    Runs count instructions, by frames of ipf with timer ticks when ipf > 0.
+    *executed is how many really ran, fewer than count when the interpreter
+    skipped idle loops, and what the rates are worked out from.
+*/
+static double timed_run(chip8_t* chip, bool use_jit, uint64_t count, uint32_t ipf, uint64_t* executed)
+{
+    jit_t* jit = use_jit ? init_jit(chip) : NULL;
+    *executed = 0;
+    const double start = now_seconds();
+    if (ipf > 0) {
+        for (uint64_t f = 0; f < count / ipf; f++)
+        {
+            if (jit) {
+                *executed += run_jit(jit, ipf);
+                tick_timers(chip);
+            } else {
+                *executed += run_frame(chip, ipf);
+            }
+        }
+    } else if (jit) {
+        *executed = run_jit(jit, count);
+    } else {
+        *executed = run_instructions(chip, count);
+    }
+    const double elapsed = now_seconds() - start;
+    if (jit) {
+        close_jit(jit);
+    }
+    return elapsed;
+}
+
+// JSON string contents, rom paths may hold quotes or backslashes
+static void print_escaped(const char* text)
+{
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\') putchar('\\');
+        putchar(*text);
+    }
+}
+
+static void usage(const char* exe)
+{
+    fprintf(stderr, "usage: %s [--repeats N] [--instructions N] [--frames N] [--ipf N] [--jit] [rom ...]\n", exe);
+}
+
+int main( int argc, char* args[] )
+{
+    uint32_t repeats = 7;
+    uint64_t instructions = 20000000;
+    uint64_t frames = 2000;
+    uint32_t ipf = 1000;
+    bool use_jit = false;
+    const char* roms[256];
+    uint32_t rom_count = 0;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(args[a], "--repeats") == 0 && a + 1 < argc) {
+            repeats = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--instructions") == 0 && a + 1 < argc) {
+            instructions = strtoull(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--frames") == 0 && a + 1 < argc) {
+            frames = strtoull(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--ipf") == 0 && a + 1 < argc) {
+            ipf = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--jit") == 0) {
+            use_jit = true;
+        } else if (args[a][0] == '-' || rom_count == 256) {
+            usage(args[0]);
+            return 1;
+        } else {
+            roms[rom_count++] = args[a];
+        }
+    }
+    if (repeats == 0 || repeats > MAX_REPEATS || ipf == 0 || instructions == 0 || frames == 0) {
+        usage(args[0]);
+        return 1;
+    }
+
+    double ns[MAX_REPEATS];
+    double ips[MAX_REPEATS];
+    double fps[MAX_REPEATS];
+
+    printf("{\n");
+    printf("  \"engine\": \"%s\",\n", use_jit ? "jit" : "interpreter");
+    printf("  \"repeats\": %u,\n", repeats);
+    printf("  \"micro\": [\n");
+    const uint32_t micro_count = sizeof(micros) / sizeof(micros[0]);
+    for (uint32_t m = 0; m < micro_count; m++)
+    {
+        for (uint32_t r = 0; r < repeats; r++)
+        {
+            chip8_t* chip = init_chip_from_memory(micros[m].program, micros[m].size);
+            uint64_t executed;
+            const double elapsed = timed_run(chip, use_jit, instructions, 0, &executed);
+            ns[r] = elapsed * 1e9 / executed;
+            ips[r] = executed / elapsed;
+            free(chip);
+        }
+        printf("    {\n");
+        printf("      \"name\": \"%s\",\n", micros[m].name);
+        printf("      \"instructions\": %llu,\n", (unsigned long long)instructions);
+        printf("      \"results\": {\n");
+        print_stats("ns_per_instruction", ns, repeats, false);
+        print_stats("instructions_per_sec", ips, repeats, true);
+        printf("      }\n");
+        printf("    }%s\n", m + 1 < micro_count ? "," : "");
+        fprintf(stderr, "%-12s %8.2f ns/instruction\n", micros[m].name, summarize(ns, repeats).mean);
+    }
+    printf("  ],\n");
+
+    printf("  \"roms\": [\n");
+    bool first = true;
+    for (uint32_t n = 0; n < rom_count; n++)
+    {
+        chip8_t* chip = init_chip(roms[n]);
+        if (!chip) {
+            continue;
+        }
+        free(chip);
+
+        uint64_t rom_executed = 0;
+        for (uint32_t r = 0; r < repeats; r++)
+        {
+            chip = init_chip(roms[n]);
+            uint64_t executed;
+            const double elapsed = timed_run(chip, use_jit, frames * ipf, ipf, &executed);
+            ns[r] = elapsed * 1e9 / executed;
+            ips[r] = executed / elapsed;
+            // the same every repeat, the machine is deterministic
+            rom_executed = executed;
+            fps[r] = frames / elapsed;
+            free(chip);
+        }
+        printf("%s    {\n", first ? "" : ",\n");
+        printf("      \"rom\": \"");
+        print_escaped(roms[n]);
+        printf("\",\n");
+        printf("      \"frames\": %llu,\n", (unsigned long long)frames);
+        printf("      \"ipf\": %u,\n", ipf);
+        printf("      \"instructions\": %llu,\n", (unsigned long long)rom_executed);
+        printf("      \"results\": {\n");
+        print_stats("ns_per_instruction", ns, repeats, false);
+        print_stats("instructions_per_sec", ips, repeats, false);
+        print_stats("frames_per_sec", fps, repeats, true);
+        printf("      }\n");
+        printf("    }");
+        first = false;
+        fprintf(stderr, "%-12s %8.2f ns/instruction %12.0f frames/sec\n", roms[n], summarize(ns, repeats).mean, summarize(fps, repeats).mean);
+    }
+    printf("%s  ]\n", first ? "" : "\n");
+    printf("}\n");
+    return 0;
+}
@@ -1,197 +1,137 @@
 #include "chip8.h"
-#include "instructions.h"
-#include "test.h"
+#include "roms.h"
 
-#include <SDL.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <stdint.h>
-
-
-
-sdl_t* init_sdl(config_t* config)
+#include <string.h>
+
+
+
+// compiled in, copied to 0x000 of every machine
+static const uint8_t font[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80, // F
+};
+
+
+// clears chip and loads the font and rom, false and stderr when the rom doesn't fit
+static bool reset_chip(chip8_t* chip, const uint8_t* rom, size_t rom_size)
 {
-    sdl_t* sdl = calloc(1, sizeof(sdl_t));
-    sdl->config = config;
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        SDL_Log("Failed to init SDL: %s\n", SDL_GetError());
-        return false;
-    }
-    sdl->window = SDL_CreateWindow(
-        "Chip8 Emulator",
-        SDL_WINDOWPOS_CENTERED,
-        SDL_WINDOWPOS_CENTERED,
-        WIDTH * sdl->config->scale_factor,
-        HEIGHT * sdl->config->scale_factor,
-        0);
-    if (!sdl->window) {
-        SDL_Log("Failed to create a window: %s\n", SDL_GetError());
-        return false;
-    }
-    
-    sdl->renderer = SDL_CreateRenderer(sdl->window, -1, SDL_RENDERER_ACCELERATED);
-    if (!sdl->renderer) {
-        SDL_Log("Failed to create a renderer: %s\n", SDL_GetError());
+    const uint32_t entry_point = 0x200;
+
+    if (rom_size > MAX_ROM_SIZE) {
+        fprintf(stderr, "Rom is too big! Rom size: %zu, max allowed: %d.\n", rom_size, MAX_ROM_SIZE);
         return false;
     }
-    return sdl;
-}
-
-void draw(sdl_t *sdl, chip8_t* chip)
-{
-    SDL_RenderClear(sdl->renderer);
 
-    SDL_Rect rect = {.x = 0, .y = 0, .w = sdl->config->scale_factor, .h = sdl->config->scale_factor};
+    // reset entire machine
+    memset(chip, 0, sizeof(chip8_t));
 
-    for (uint32_t i = 0; i < sizeof chip->display; i++)
-    {
-        rect.x = (i % WIDTH) * sdl->config->scale_factor;
-        rect.y = (i / WIDTH) * sdl->config->scale_factor;
+    // load font
+    memcpy(&chip->memory[0], font, sizeof(font));
 
-        if (chip->display[i]) 
-        {
-            // if pixel is on draw fg colour
-            SDL_SetRenderDrawColor(sdl->renderer, 0, 0xFF, 0, 0);
-            SDL_RenderFillRect(sdl->renderer, &rect);
-        } 
-        else 
-        {
-            // if pixel is off draw bg colour
-            SDL_SetRenderDrawColor(sdl->renderer, 0x00, 0x00, 0x00, 0x00);
-            SDL_RenderFillRect(sdl->renderer, &rect);
-        }
+    // load rom
+    if (rom_size > 0) {
+        memcpy(&chip->memory[entry_point], rom, rom_size);
     }
-    SDL_RenderPresent(sdl->renderer);
+
+    // defaults
+    chip->pc        = entry_point;
+    chip->rng       = 0x2545F491;
+    return true;
 }
 
-void close_sdl(sdl_t *sdl)
+chip8_t* init_chip_from_memory(const uint8_t* rom, size_t rom_size)
 {
-    //Destroy window
-    SDL_DestroyWindow( sdl->window );
-
-    //Quit SDL subsystems
-    SDL_Quit();
+    chip8_t* chip = malloc(sizeof(chip8_t));
+    if (!chip || !reset_chip(chip, rom, rom_size)) {
+        free(chip);
+        return NULL;
+    }
+    return chip;
 }
 
-chip8_t* init_chip(char* rom_name)
+chip8_t* init_chip_in_arena(arena_t* arena, const uint8_t* rom, size_t rom_size)
 {
-    chip8_t* chip = calloc(1, sizeof(chip8_t));
-
-    const uint32_t entry_point = 0x200;
-
-    const uint8_t font[] = {
-        0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-        0x20, 0x60, 0x20, 0x20, 0x70, // 1
-        0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-        0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-        0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-        0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-        0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-        0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-        0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-        0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-        0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-        0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-        0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-        0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-        0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-        0xF0, 0x80, 0xF0, 0x80, 0x80, // F
-    };
-
-    // reset entire machine
-    memset(chip, 0, sizeof(chip8_t));
-
-    // load font
-    memcpy(&chip->memory[0], font, sizeof(font));
-
-    // load rom
-    FILE *rom = fopen(rom_name, "rb");
-    if (!rom) {
-        SDL_Log("Failed to load rom file %s\n", rom_name);
-        return false;
+    chip8_t* chip = arena_alloc(arena, sizeof(chip8_t));
+    if (!chip || !reset_chip(chip, rom, rom_size)) {
+        return NULL;
     }
+    return chip;
+}
 
-    // get rom size
-    fseek(rom, 0, SEEK_END);
-    const size_t rom_size = ftell(rom);
-    const size_t max_size = sizeof chip->memory - entry_point;
-    rewind(rom);
-
-    if (rom_size > max_size) {
-        SDL_Log("Rom file %s is too big! Rom size: %zu, max allowed: %zu.\n", rom_name, rom_size, max_size);
-        return false;
+chip8_t* init_chip(const char* rom_name)
+{
+    // read once and shared, loading the same rom again costs a lookup and a stat()
+    const rom_t* rom = load_rom(shared_roms(), rom_name);
+    if (!rom) {
+        return NULL;
     }
+    return init_chip_from_memory(rom->data, rom->size);
+}
 
-    if (fread(&chip->memory[entry_point], rom_size, 1, rom) != 1) {
-        SDL_Log("Failed to load rom file into vm's ram\n");
-        return false;
-    };
 
-    fclose(rom);
+static const struct
+{
+    const char* name;
+    uint8_t flags;
+} profiles[QUIRKS_COUNT] = {
+    [QUIRKS_MODERN] = { "modern", MODERN_QUIRKS },
+    [QUIRKS_VIP]    = { "vip", VIP_QUIRKS },
+    [QUIRKS_SCHIP]  = { "schip", SCHIP_QUIRKS },
+    [QUIRKS_XOCHIP] = { "xochip", XOCHIP_QUIRKS },
+};
+
+uint8_t quirk_flags(quirks_t quirks)
+{
+    return quirks < QUIRKS_COUNT ? profiles[quirks].flags : MODERN_QUIRKS;
+}
 
-    // defaults
-    chip->instruction = calloc(1, sizeof(instruction_t));
-    chip->pc        = entry_point;
-    chip->rom_name  = rom_name;
-    chip->stack_ptr = &chip->stack[0];
-    return chip;
+const char* quirks_name(quirks_t quirks)
+{
+    return quirks < QUIRKS_COUNT ? profiles[quirks].name : "unknown";
 }
 
+quirks_t find_quirks(const char* name)
+{
+    quirks_t quirks = 0;
+    while (quirks < QUIRKS_COUNT && strcmp(profiles[quirks].name, name) != 0) quirks++;
+    return quirks;
+}
 
 
-int main( int argc, char* args[] )
+uint64_t hash_display(chip8_t* chip)
 {
-    // configure
-    config_t* config = calloc(1, sizeof(config_t));
-    config->scale_factor = 5;
-    
-    // initialize the window
-    sdl_t* sdl = init_sdl(config);
-    
-    // init ship and load rom
-    chip8_t* chip = init_chip("roms/IBM Logo.ch8");
-    
-    SDL_Event event; 
-    bool quit = false;
-    memset(&chip->display[0], true, sizeof(chip->display));
-    #ifdef TEST
-        test_all();
-    #else
-
-    
-    while( quit == false )
-    { 
-        #ifdef DEBUG
-            if(SDL_WaitEvent(&event)){
-                if(event.type == SDL_QUIT){
-                    quit = true;
-                }else if(event.type == SDL_MOUSEBUTTONDOWN){
-                    // run next instruction
-                    run_instruction(chip);
-                }
-                
-            }
-        #else
-            while( SDL_PollEvent( &event ) )
-            { 
-                if( event.type == SDL_QUIT ) 
-                {
-                    quit = true;
-                }
-            }
-            // run next instruction
-            run_instruction(chip);
-        #endif
-        
-        // draw screen
-        if(chip->redraw){
-            draw(sdl, chip);
+    // hashed one byte per pixel so values stay comparable with older builds
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (uint8_t y = 0; y < HEIGHT; y++)
+    {
+        for (uint8_t x = 0; x < WIDTH; x++)
+        {
+            hash ^= get_pixel(chip, x, y);
+            hash *= 0x100000001b3ULL;
         }
     }
-    #endif
-    return 0;
+    return hash;
 }
 
-
-
+void fill_display(chip8_t* chip, bool on)
+{
+    memset(&chip->display[0], on ? 0xFF : 0x00, sizeof(chip->display));
+}
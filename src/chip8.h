@@ -3,7 +3,8 @@
 
 
 
-#include <SDL.h>
+#include "arena.h"
+
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -12,53 +13,167 @@
 #define  WIDTH 64
 #define  HEIGHT 32
 
+// default instructions executed per 60 Hz frame
+#define  INSTRUCTIONS_PER_FRAME 11
+#define  FRAME_RATE 60
+
+// programs load at 0x200 and may fill the rest of memory
+#define  MAX_ROM_SIZE (4096 - 0x200)
+
 
 typedef struct {
     uint16_t opcode; // 16 bit opcode
-    uint8_t nnn;    // nnn or addr - A 12-bit value, the lowest 12 bits of the instruction
+    uint16_t nnn;   // nnn or addr - A 12-bit value, the lowest 12 bits of the instruction
     uint8_t n;      // n or nibble - A 4-bit value, the lowest 4 bits of the instruction
     uint8_t x;      // x - A 4-bit value, the lower 4 bits of the high byte of the instruction
     uint8_t y;      // y - A 4-bit value, the upper 4 bits of the low byte of the instruction
     uint8_t kk;     // kk or byte - An 8-bit value, the lowest 8 bits of the instruction
 } instruction_t;
 
-typedef struct
-{
-    uint8_t scale_factor;
-} config_t;
-
-typedef struct
-{
-    SDL_Window *window;
-    SDL_Renderer *renderer;
-    config_t* config;
-} sdl_t;
-
-
-
+// how the last run_instructions() ended, chip8_t.idle
+typedef enum {
+    IDLE_NONE = 0,  // ran every instruction it was asked to
+    IDLE_LOOP,      // jump to self or delay timer poll, nothing changes before the next timer tick
+    IDLE_KEY,       // Fx0A with no key down, nothing changes before a key goes down
+} idle_t;
+
+/*
+    Behaviours the historical interpreters disagree on. A quirk profile,
+    chip8_t.quirks, is a fixed set of them; the interpreter is compiled once
+    per profile (see dispatch.h).
+*/
+#define QUIRK_SHIFT_VY      0x01    // 8xy6/8xyE shift Vy into Vx, not Vx in place
+#define QUIRK_LOAD_STORE_I  0x02    // Fx55/Fx65 leave I past the last register
+#define QUIRK_WRAP          0x04    // Dxyn wraps sprites around the edges instead of clipping
+#define QUIRK_VF_RESET      0x08    // 8xy1/8xy2/8xy3 clear VF
+#define QUIRK_DISPLAY_WAIT  0x10    // Dxyn ends run_instructions(), one draw per frame
+#define QUIRK_JUMP_VX       0x20    // Bxnn jumps to xnn + Vx, not nnn + V0
+
+#define MODERN_QUIRKS   0
+#define VIP_QUIRKS      (QUIRK_SHIFT_VY | QUIRK_LOAD_STORE_I | QUIRK_VF_RESET | QUIRK_DISPLAY_WAIT)
+#define SCHIP_QUIRKS    (QUIRK_JUMP_VX)
+#define XOCHIP_QUIRKS   (QUIRK_SHIFT_VY | QUIRK_LOAD_STORE_I | QUIRK_WRAP)
+
+typedef enum {
+    QUIRKS_MODERN = 0,  // what most roms written since expect, and all the jit, aot and lockstep cores run
+    QUIRKS_VIP,         // the original COSMAC VIP interpreter
+    QUIRKS_SCHIP,       // SUPER-CHIP 1.1 on the HP 48
+    QUIRKS_XOCHIP,      // Octo and XO-CHIP
+    QUIRKS_COUNT
+} quirks_t;
+
+// pre-decoded instruction, one slot per pc in chip8_t.decoded
+typedef struct {
+    uint8_t op;     // dispatch index (op_t), OP_NONE until the slot is decoded
+    uint8_t x;      // x - lower 4 bits of the high byte, nnn is x << 8 | kk
+    uint8_t y;      // y - upper 4 bits of the low byte
+    uint8_t kk;     // kk - low byte, n is kk & 0xF
+} decoded_t;
+
+
+/*
+    Plain data, no pointers: a machine can be copied with memcpy. The fields
+    up to rng are the emulated machine and what a save state holds (state.h),
+    the rest are host-side caches rebuilt from it.
+*/
 typedef struct
 {
     uint8_t memory[4096];
-    bool display[32 * 64];
+    uint64_t display[HEIGHT]; // one row per word, bit 63 is x = 0, read through get_pixel()/get_row()
     uint16_t stack[12];
-    uint16_t* stack_ptr;
+    uint8_t sp;     // index of the top of stack, stack[0] when empty
     uint8_t v[16];
     uint16_t i;
     uint16_t pc;
     uint8_t delay_timer;
     uint8_t sound_timer;
     bool keypad[16];
-    const char *rom_name;
-    instruction_t* instruction;
+    uint32_t rng;   // xorshift32 state for Cxkk
+
+    instruction_t instruction; // last instruction decoded on a cache miss
     bool redraw;
+    uint8_t idle;   // idle_t, set when run_instructions() skipped the rest of an idle loop
+    uint8_t quirks; // quirks_t the machine runs with, QUIRKS_MODERN unless set after init
+    uint64_t written_pages; // one bit per 64-byte page written by the program, cleared by whoever consumes it (jit)
+    uint16_t keys_read; // one bit per key Ex9E, ExA1 or Fx0A looked at, cleared by whoever consumes it (latency)
+    uint64_t fork_stamp; // set by every enter_fork(), 0 from init, tells fork.c whether memory is still what it copied in
+    decoded_t decoded[4096]; // decode cache indexed by pc, see invalidate_decoded()
 } chip8_t;
 
-void PrintEvent(const SDL_Event *event, sdl_t *sdl);
+chip8_t* init_chip(const char* rom_name);
 
-sdl_t *init_sdl(config_t *config);
+// same as init_chip() for a rom image already in memory
+chip8_t* init_chip_from_memory(const uint8_t* rom, size_t rom_size);
 
-void draw(sdl_t *sdl, chip8_t* chip);
+// same again with the machine allocated from arena, freed by reset_arena() instead of free()
+chip8_t* init_chip_in_arena(arena_t* arena, const uint8_t* rom, size_t rom_size);
 
-void close_sdl(sdl_t *sdl);
+// QUIRK_* flags of a profile
+uint8_t quirk_flags(quirks_t quirks);
 
-#endif
\ No newline at end of file
+// "modern", "vip", "schip" or "xochip", and back; QUIRKS_COUNT for a name that isn't one
+const char* quirks_name(quirks_t quirks);
+quirks_t find_quirks(const char* name);
+
+// FNV-1a hash of the display, used to compare runs without a window
+uint64_t hash_display(chip8_t* chip);
+
+// set every pixel on or off
+void fill_display(chip8_t* chip, bool on);
+
+
+static inline uint64_t get_row(const chip8_t* chip, uint8_t y)
+{
+    return chip->display[y];
+}
+
+static inline bool get_pixel(const chip8_t* chip, uint8_t x, uint8_t y)
+{
+    return (chip->display[y] >> (WIDTH - 1 - x)) & 1;
+}
+
+static inline void set_pixel(chip8_t* chip, uint8_t x, uint8_t y, bool on)
+{
+    const uint64_t bit = 1ULL << (WIDTH - 1 - x);
+    chip->display[y] = on ? chip->display[y] | bit : chip->display[y] & ~bit;
+}
+
+// XORs n sprite rows from memory[addr] onto the display at (x, y), true when a lit pixel was erased
+static inline bool draw_sprite(chip8_t* chip, uint8_t x, uint8_t y, uint16_t addr, uint8_t n)
+{
+    x %= WIDTH;
+    y %= HEIGHT;
+
+    // rows past the bottom edge are clipped, the shift clips at the right edge
+    const uint8_t rows = y + n > HEIGHT ? HEIGHT - y : n;
+    uint64_t collision = 0;
+
+    for (uint8_t r = 0; r < rows; r++) {
+        const uint64_t sprite = (uint64_t)chip->memory[(addr + r) & 0xFFF] << (WIDTH - 8) >> x;
+        collision |= chip->display[y + r] & sprite;
+        chip->display[y + r] ^= sprite;
+    }
+    chip->redraw = true; // will update the screen on next tick
+    return collision != 0;
+}
+
+// draw_sprite() under QUIRK_WRAP: columns and rows past an edge come back in at the opposite one
+static inline bool wrap_sprite(chip8_t* chip, uint8_t x, uint8_t y, uint16_t addr, uint8_t n)
+{
+    x %= WIDTH;
+    y %= HEIGHT;
+    uint64_t collision = 0;
+
+    for (uint8_t r = 0; r < n; r++) {
+        const uint64_t bits = (uint64_t)chip->memory[(addr + r) & 0xFFF] << (WIDTH - 8);
+        // rotated right by x
+        const uint64_t sprite = x ? bits >> x | bits << (WIDTH - x) : bits;
+        const uint8_t row = (y + r) % HEIGHT;
+        collision |= chip->display[row] & sprite;
+        chip->display[row] ^= sprite;
+    }
+    chip->redraw = true;
+    return collision != 0;
+}
+
+#endif
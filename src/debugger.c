@@ -0,0 +1,492 @@
+#include "debugger.h"
+#include "chip8.h"
+#include "instructions.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct
+{
+    uint8_t reg;        // 0-15 for Vx, DEBUG_REG_I
+    uint8_t op;         // condition_op_t
+    uint16_t value;
+    bool held;          // true after the last instruction, a run stops when it goes from false to true
+} condition_t;
+
+struct debugger
+{
+    chip8_t* chip;
+    uint32_t ipf;
+    uint64_t frame;             // frames completed
+    uint32_t in_frame;          // instructions run into the current frame
+    uint64_t until_frame;       // where a continue or frame command stops, UINT64_MAX for none
+    bool on_break;              // the last run stopped on the breakpoint at pc, the next runs the instruction there
+
+    uint64_t breakpoints[4096 / 64];    // one bit per pc
+    uint32_t breakpoint_count;
+    uint64_t watched[4096 / 64];        // one bit per watched byte
+    uint64_t watch_pages;               // pages holding a watched byte, like chip8_t.written_pages
+    uint8_t shadow[4096];               // watched bytes as the last check saw them
+    condition_t conditions[DEBUG_CONDITIONS];
+    uint8_t condition_count;
+
+    debug_stop_t stop;
+};
+
+
+static const char* const condition_ops[] = { "==", "!=", "<", ">", "<=", ">=" };
+
+static bool has_bit(const uint64_t* bits, uint16_t n)
+{
+    return (bits[n / 64] >> (n % 64)) & 1;
+}
+
+static uint16_t register_value(const chip8_t* chip, uint8_t reg)
+{
+    return reg == DEBUG_REG_I ? chip->i : chip->v[reg];
+}
+
+static bool condition_holds(const chip8_t* chip, const condition_t* c)
+{
+    const uint16_t value = register_value(chip, c->reg);
+    switch (c->op)
+    {
+        case COND_EQ: return value == c->value;
+        case COND_NE: return value != c->value;
+        case COND_LT: return value < c->value;
+        case COND_GT: return value > c->value;
+        case COND_LE: return value <= c->value;
+        default:      return value >= c->value;
+    }
+}
+
+static uint16_t opcode_at(const chip8_t* chip, uint16_t addr)
+{
+    return chip->memory[addr & 0xFFF] << 8 | chip->memory[(addr + 1) & 0xFFF];
+}
+
+// pages is the watched pages the last instruction wrote to, true and the first changed byte in stop when one changed
+static bool check_watch(debugger_t* dbg, uint64_t pages)
+{
+    bool changed = false;
+    for (; pages; pages &= pages - 1)
+    {
+        const uint16_t page = __builtin_ctzll(pages);
+        const uint64_t watched = dbg->watched[page];
+        for (uint16_t addr = page * 64; addr < page * 64 + 64; addr++)
+        {
+            if (!((watched >> (addr % 64)) & 1) || dbg->chip->memory[addr] == dbg->shadow[addr]) continue;
+            if (!changed) {
+                dbg->stop.addr = addr;
+                dbg->stop.before = dbg->shadow[addr];
+                dbg->stop.after = dbg->chip->memory[addr];
+                changed = true;
+            }
+            dbg->shadow[addr] = dbg->chip->memory[addr];
+        }
+    }
+    return changed;
+}
+
+// every condition is brought up to date, true and the first that went true in stop when one did
+static bool check_conditions(debugger_t* dbg)
+{
+    bool fired = false;
+    for (uint8_t c = 0; c < dbg->condition_count; c++)
+    {
+        condition_t* condition = &dbg->conditions[c];
+        const bool held = condition_holds(dbg->chip, condition);
+        if (held && !condition->held && !fired) {
+            dbg->stop.condition = c;
+            fired = true;
+        }
+        condition->held = held;
+    }
+    return fired;
+}
+
+// ticks the timers once a frame's instructions have all run, true when that reaches until_frame
+static bool end_frame(debugger_t* dbg, uint64_t until_frame)
+{
+    if (dbg->in_frame < dbg->ipf) {
+        return false;
+    }
+    tick_timers(dbg->chip);
+    dbg->frame++;
+    dbg->in_frame = 0;
+    return dbg->frame >= until_frame;
+}
+
+static stop_t run(debugger_t* dbg, uint64_t count, uint64_t until_frame)
+{
+    chip8_t* chip = dbg->chip;
+    const bool display_wait = quirk_flags(chip->quirks) & QUIRK_DISPLAY_WAIT;
+    memset(&dbg->stop, 0, sizeof(dbg->stop));
+
+    if (dbg->frame >= until_frame) {
+        dbg->stop.reason = STOP_FRAME;
+        dbg->stop.pc = chip->pc & 0xFFF;
+        return STOP_FRAME;
+    }
+    while (count > 0)
+    {
+        const uint32_t left = dbg->ipf - dbg->in_frame;
+
+        // nothing to check between instructions: the rest of the frame in one go, unless a draw
+        // ending the frame early under QUIRK_DISPLAY_WAIT would land inside a shorter run
+        if (!debug_armed(dbg) && (count >= left || !display_wait)) {
+            const uint32_t n = count < left ? count : left;
+            run_instructions(chip, n);
+            dbg->on_break = false;
+            count -= n;
+            dbg->in_frame += n;
+        } else {
+            const uint16_t pc = chip->pc & 0xFFF;
+            dbg->stop.pc = pc;
+            // a run starting where the last stopped on a breakpoint runs the instruction there, that's how a continue gets past it
+            if (has_bit(dbg->breakpoints, pc) && !dbg->on_break) {
+                dbg->stop.reason = STOP_BREAK;
+                dbg->on_break = true;
+                return STOP_BREAK;
+            }
+            dbg->on_break = false;
+            const bool draw = (opcode_at(chip, pc) & 0xF000) == 0xD000;
+
+            // the bits the program set are kept for whoever else consumes them
+            const uint64_t written = chip->written_pages;
+            chip->written_pages = 0;
+            run_instructions(chip, 1);
+            const uint64_t pages = chip->written_pages & dbg->watch_pages;
+            chip->written_pages |= written;
+
+            count--;
+            dbg->in_frame = display_wait && draw ? dbg->ipf : dbg->in_frame + 1;
+            const bool watch_hit = pages && check_watch(dbg, pages);
+            const bool condition_hit = check_conditions(dbg);
+            const bool frame_hit = end_frame(dbg, until_frame);
+            if (watch_hit || condition_hit) {
+                dbg->stop.reason = watch_hit ? STOP_WATCH : STOP_CONDITION;
+                return dbg->stop.reason;
+            }
+            if (frame_hit) {
+                dbg->stop.reason = STOP_FRAME;
+                return STOP_FRAME;
+            }
+            continue;
+        }
+        if (end_frame(dbg, until_frame)) {
+            dbg->stop.reason = STOP_FRAME;
+            dbg->stop.pc = chip->pc & 0xFFF;
+            return STOP_FRAME;
+        }
+    }
+    dbg->stop.pc = chip->pc & 0xFFF;
+    return STOP_NONE;
+}
+
+
+debugger_t* init_debugger(chip8_t* chip, uint32_t ipf)
+{
+    debugger_t* dbg = calloc(1, sizeof(debugger_t));
+    if (!dbg) {
+        fprintf(stderr, "Not enough memory for the debugger\n");
+        return NULL;
+    }
+    dbg->chip = chip;
+    dbg->ipf = ipf ? ipf : INSTRUCTIONS_PER_FRAME;
+    dbg->until_frame = UINT64_MAX;
+    return dbg;
+}
+
+void close_debugger(debugger_t* dbg)
+{
+    free(dbg);
+}
+
+bool add_breakpoint(debugger_t* dbg, uint16_t addr)
+{
+    addr &= 0xFFF;
+    if (has_bit(dbg->breakpoints, addr)) {
+        return false;
+    }
+    dbg->breakpoints[addr / 64] |= 1ULL << (addr % 64);
+    dbg->breakpoint_count++;
+    return true;
+}
+
+bool remove_breakpoint(debugger_t* dbg, uint16_t addr)
+{
+    addr &= 0xFFF;
+    if (!has_bit(dbg->breakpoints, addr)) {
+        return false;
+    }
+    dbg->breakpoints[addr / 64] &= ~(1ULL << (addr % 64));
+    dbg->breakpoint_count--;
+    return true;
+}
+
+void watch_memory(debugger_t* dbg, uint16_t addr, uint16_t len)
+{
+    for (uint32_t n = 0; n < len && n < 4096; n++)
+    {
+        const uint16_t a = (addr + n) & 0xFFF;
+        dbg->watched[a / 64] |= 1ULL << (a % 64);
+        dbg->watch_pages |= 1ULL << (a / 64);
+        dbg->shadow[a] = dbg->chip->memory[a];
+    }
+}
+
+void unwatch_memory(debugger_t* dbg, uint16_t addr, uint16_t len)
+{
+    for (uint32_t n = 0; n < len && n < 4096; n++)
+    {
+        const uint16_t a = (addr + n) & 0xFFF;
+        dbg->watched[a / 64] &= ~(1ULL << (a % 64));
+        if (dbg->watched[a / 64] == 0) {
+            dbg->watch_pages &= ~(1ULL << (a / 64));
+        }
+    }
+}
+
+int add_condition(debugger_t* dbg, uint8_t reg, condition_op_t op, uint16_t value)
+{
+    if (dbg->condition_count == DEBUG_CONDITIONS || reg > DEBUG_REG_I || op > COND_GE) {
+        return -1;
+    }
+    condition_t* c = &dbg->conditions[dbg->condition_count];
+    c->reg = reg;
+    c->op = op;
+    c->value = value;
+    // already true doesn't stop anything, becoming true does
+    c->held = condition_holds(dbg->chip, c);
+    return dbg->condition_count++;
+}
+
+void clear_conditions(debugger_t* dbg)
+{
+    dbg->condition_count = 0;
+}
+
+bool debug_armed(const debugger_t* dbg)
+{
+    return dbg->breakpoint_count || dbg->watch_pages || dbg->condition_count;
+}
+
+stop_t debug_run(debugger_t* dbg, uint64_t count)
+{
+    return run(dbg, count, UINT64_MAX);
+}
+
+stop_t debug_run_to_frame(debugger_t* dbg, uint64_t frame)
+{
+    return run(dbg, UINT64_MAX, frame);
+}
+
+const debug_stop_t* debug_last_stop(const debugger_t* dbg)
+{
+    return &dbg->stop;
+}
+
+uint64_t debug_frame(const debugger_t* dbg)
+{
+    return dbg->frame;
+}
+
+uint32_t debug_in_frame(const debugger_t* dbg)
+{
+    return dbg->in_frame;
+}
+
+
+// front end commands
+
+static void print_condition(const condition_t* c, FILE* out)
+{
+    if (c->reg == DEBUG_REG_I) {
+        fprintf(out, "I %s %.3X", condition_ops[c->op], c->value);
+    } else {
+        fprintf(out, "V%X %s %.2X", c->reg, condition_ops[c->op], c->value);
+    }
+}
+
+static void print_instruction(const debugger_t* dbg, uint16_t addr, FILE* out)
+{
+    char text[32];
+    const uint16_t opcode = opcode_at(dbg->chip, addr);
+    disassemble(opcode, text, sizeof(text));
+    fprintf(out, "%c%c%.3X: %.4X  %s\n",
+            addr == (dbg->chip->pc & 0xFFF) ? '>' : ' ', has_bit(dbg->breakpoints, addr) ? '*' : ' ',
+            addr, opcode, text);
+}
+
+// frame and the instruction about to run
+static void print_position(const debugger_t* dbg, FILE* out)
+{
+    fprintf(out, "frame %llu+%u ", (unsigned long long)dbg->frame, dbg->in_frame);
+    print_instruction(dbg, dbg->chip->pc & 0xFFF, out);
+}
+
+static void print_stop(const debugger_t* dbg, FILE* out)
+{
+    const debug_stop_t* stop = &dbg->stop;
+    switch (stop->reason)
+    {
+        case STOP_BREAK:
+            fprintf(out, "breakpoint %.3X\n", stop->pc);
+            break;
+        case STOP_WATCH:
+            fprintf(out, "watchpoint [%.3X] %.2X -> %.2X by %.3X\n", stop->addr, stop->before, stop->after, stop->pc);
+            break;
+        case STOP_CONDITION:
+            fprintf(out, "condition %u, ", stop->condition);
+            print_condition(&dbg->conditions[stop->condition], out);
+            fprintf(out, " by %.3X\n", stop->pc);
+            break;
+        default:
+            break;
+    }
+    print_position(dbg, out);
+}
+
+static void print_registers(const chip8_t* chip, FILE* out)
+{
+    fprintf(out, "PC=%.3X I=%.3X SP=%X DT=%.2X ST=%.2X\n", chip->pc, chip->i, chip->sp, chip->delay_timer, chip->sound_timer);
+    for (uint8_t r = 0; r < 16; r++)
+    {
+        fprintf(out, "V%X=%.2X%c", r, chip->v[r], r % 8 == 7 ? '\n' : ' ');
+    }
+    fprintf(out, "stack");
+    for (uint8_t s = 1; s <= chip->sp; s++)
+    {
+        fprintf(out, " %.3X", chip->stack[s]);
+    }
+    fprintf(out, "\n");
+}
+
+static void print_memory(const chip8_t* chip, uint16_t addr, uint16_t len, FILE* out)
+{
+    for (uint32_t n = 0; n < len; n++)
+    {
+        const uint16_t a = (addr + n) & 0xFFF;
+        if (n % 16 == 0) fprintf(out, "%.3X:", a);
+        fprintf(out, " %.2X", chip->memory[a]);
+        if (n % 16 == 15 || n + 1 == len) fprintf(out, "\n");
+    }
+}
+
+// "v0" to "vf" or "i", false for anything else
+static bool parse_register(const char* name, uint8_t* reg)
+{
+    if ((name[0] == 'i' || name[0] == 'I') && name[1] == '\0') {
+        *reg = DEBUG_REG_I;
+        return true;
+    }
+    char* end;
+    if ((name[0] != 'v' && name[0] != 'V') || name[1] == '\0') {
+        return false;
+    }
+    const unsigned long r = strtoul(name + 1, &end, 16);
+    if (*end != '\0' || r > 15) {
+        return false;
+    }
+    *reg = r;
+    return true;
+}
+
+static const char* const help =
+    "step [N]           run N instructions\n"
+    "continue           run until a breakpoint, watchpoint or condition\n"
+    "frame N            run until N frames have completed\n"
+    "break ADDR         breakpoint, delete ADDR removes it\n"
+    "watch ADDR [LEN]   watchpoint, unwatch ADDR [LEN] removes it\n"
+    "when REG OP VALUE  condition, e.g. when v3 == 05, unwhen clears them\n"
+    "key K 1|0          hold or let go of key K\n"
+    "regs               registers\n"
+    "mem ADDR [LEN]     memory\n"
+    "dis [ADDR] [N]     disassembly\n"
+    "quit\n"
+    "numbers are hex\n";
+
+debug_state_t debug_command(debugger_t* dbg, const char* line, FILE* out)
+{
+    chip8_t* chip = dbg->chip;
+    char command[16] = "";
+    char arg[16] = "";
+    char op[4] = "";
+    unsigned int a = 0;
+    unsigned int b = 0;
+    const int fields = sscanf(line, "%15s %x %x", command, &a, &b);
+
+    if (fields < 1) {
+        return DEBUG_STOPPED;
+    }
+    if (strcmp(command, "step") == 0 || strcmp(command, "s") == 0) {
+        debug_run(dbg, fields >= 2 ? a : 1);
+        print_stop(dbg, out);
+    } else if (strcmp(command, "continue") == 0 || strcmp(command, "c") == 0) {
+        dbg->until_frame = UINT64_MAX;
+        return DEBUG_RUNNING;
+    } else if (strcmp(command, "frame") == 0 && fields >= 2) {
+        dbg->until_frame = a;
+        return DEBUG_RUNNING;
+    } else if (strcmp(command, "break") == 0 && fields >= 2) {
+        if (!add_breakpoint(dbg, a)) fprintf(out, "already a breakpoint at %.3X\n", a & 0xFFF);
+    } else if (strcmp(command, "delete") == 0 && fields >= 2) {
+        if (!remove_breakpoint(dbg, a)) fprintf(out, "no breakpoint at %.3X\n", a & 0xFFF);
+    } else if (strcmp(command, "watch") == 0 && fields >= 2) {
+        watch_memory(dbg, a, fields >= 3 ? b : 1);
+    } else if (strcmp(command, "unwatch") == 0 && fields >= 2) {
+        unwatch_memory(dbg, a, fields >= 3 ? b : 1);
+    } else if (strcmp(command, "when") == 0) {
+        uint8_t reg;
+        int c = -1;
+        if (sscanf(line, "%*s %15s %3s %x", arg, op, &a) == 3 && parse_register(arg, &reg)) {
+            for (uint8_t o = 0; o < sizeof(condition_ops) / sizeof(condition_ops[0]); o++)
+            {
+                if (strcmp(op, condition_ops[o]) == 0) c = add_condition(dbg, reg, o, a);
+            }
+        }
+        if (c < 0) fprintf(out, "when V0-VF|I ==|!=|<|>|<=|>= VALUE, up to %u\n", DEBUG_CONDITIONS);
+    } else if (strcmp(command, "unwhen") == 0) {
+        clear_conditions(dbg);
+    } else if (strcmp(command, "key") == 0 && fields >= 3) {
+        chip->keypad[a & 0xF] = b != 0;
+    } else if (strcmp(command, "regs") == 0 || strcmp(command, "r") == 0) {
+        print_registers(chip, out);
+    } else if (strcmp(command, "mem") == 0 && fields >= 2) {
+        print_memory(chip, a, fields >= 3 ? b : 64, out);
+    } else if (strcmp(command, "dis") == 0 || strcmp(command, "d") == 0) {
+        const uint16_t from = fields >= 2 ? a : chip->pc;
+        for (uint32_t n = 0; n < (fields >= 3 ? b : 8); n++) print_instruction(dbg, (from + n * 2) & 0xFFF, out);
+    } else if (strcmp(command, "quit") == 0 || strcmp(command, "q") == 0) {
+        return DEBUG_QUIT;
+    } else if (strcmp(command, "help") == 0) {
+        fputs(help, out);
+    } else {
+        fprintf(out, "unknown command %s, help lists them\n", command);
+    }
+    return DEBUG_STOPPED;
+}
+
+debug_state_t debug_continue(debugger_t* dbg, FILE* out)
+{
+    const uint64_t next = dbg->frame + 1;
+    const stop_t stop = run(dbg, UINT64_MAX, next < dbg->until_frame ? next : dbg->until_frame);
+    if (stop == STOP_FRAME && dbg->frame < dbg->until_frame) {
+        return DEBUG_RUNNING;
+    }
+    dbg->until_frame = UINT64_MAX;
+    print_stop(dbg, out);
+    return DEBUG_STOPPED;
+}
+
+void debug_interrupt(debugger_t* dbg, FILE* out)
+{
+    dbg->until_frame = UINT64_MAX;
+    fprintf(out, "interrupted\n");
+    print_position(dbg, out);
+}
@@ -0,0 +1,121 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+// register conditions armed at once
+#define DEBUG_CONDITIONS 8
+
+// index of I in a condition, V0 to VF are 0 to 15
+#define DEBUG_REG_I 16
+
+/*
+    Interactive debugger over one interpreted machine, run by frames of ipf
+    instructions with a timer tick after each like run_frame(). PC
+    breakpoints, memory watchpoints and register conditions are checked
+    between instructions, so while any is armed the machine runs one
+    instruction per run_instructions(); with none armed every run goes
+    straight through run_instructions() a frame at a time, the same fast
+    path as without a debugger.
+
+    Watchpoints ride on chip8_t.written_pages: only a watched 64-byte page
+    the instruction wrote to is compared against the debugger's copy.
+*/
+typedef struct debugger debugger_t;
+
+// why the last run stopped
+typedef enum {
+    STOP_NONE = 0,      // ran every instruction it was asked to
+    STOP_BREAK,         // pc reached a breakpoint, the instruction there hasn't run
+    STOP_WATCH,         // an instruction changed a watched byte
+    STOP_CONDITION,     // a register condition went from false to true
+    STOP_FRAME,         // reached the frame asked for
+} stop_t;
+
+typedef enum {
+    COND_EQ = 0,        // ==
+    COND_NE,            // !=
+    COND_LT,            // <
+    COND_GT,            // >
+    COND_LE,            // <=
+    COND_GE,            // >=
+} condition_op_t;
+
+typedef struct
+{
+    stop_t reason;
+    uint16_t pc;        // of the instruction that stopped the run, the one not yet run for STOP_BREAK
+    uint16_t addr;      // first watched byte changed, STOP_WATCH
+    uint8_t before;     // and its value before and after
+    uint8_t after;
+    uint8_t condition;  // index of the condition that went true, STOP_CONDITION
+} debug_stop_t;
+
+// what a front end does next after debug_command()
+typedef enum {
+    DEBUG_STOPPED = 0,  // read the next command
+    DEBUG_RUNNING,      // call debug_continue() until it says otherwise
+    DEBUG_QUIT,
+} debug_state_t;
+
+// chip stays the caller's, ipf = 0 runs INSTRUCTIONS_PER_FRAME per frame
+debugger_t* init_debugger(chip8_t* chip, uint32_t ipf);
+void close_debugger(debugger_t* dbg);
+
+// false when addr already has one, or has none to remove
+bool add_breakpoint(debugger_t* dbg, uint16_t addr);
+bool remove_breakpoint(debugger_t* dbg, uint16_t addr);
+
+// memory[addr, addr + len) stops a run when an instruction changes it
+void watch_memory(debugger_t* dbg, uint16_t addr, uint16_t len);
+void unwatch_memory(debugger_t* dbg, uint16_t addr, uint16_t len);
+
+// stops a run when reg (0-15 for Vx, DEBUG_REG_I) op value becomes true; -1 when all are taken
+int add_condition(debugger_t* dbg, uint8_t reg, condition_op_t op, uint16_t value);
+void clear_conditions(debugger_t* dbg);
+
+// true while any breakpoint, watchpoint or condition would stop a run
+bool debug_armed(const debugger_t* dbg);
+
+// runs up to count instructions, stopping early on a breakpoint, watchpoint or condition
+stop_t debug_run(debugger_t* dbg, uint64_t count);
+
+// runs until frame 60 Hz frames have completed, STOP_FRAME unless something else stopped it first
+stop_t debug_run_to_frame(debugger_t* dbg, uint64_t frame);
+
+// details of the stop the last run ended with
+const debug_stop_t* debug_last_stop(const debugger_t* dbg);
+
+// frames completed and instructions run into the current one
+uint64_t debug_frame(const debugger_t* dbg);
+uint32_t debug_in_frame(const debugger_t* dbg);
+
+/*
+    Runs one command line, printing to out:
+        step [N]            run N instructions, 1 by default
+        continue            run until something stops it
+        frame N             run until N frames have completed
+        break ADDR          breakpoint at ADDR, delete ADDR removes it
+        watch ADDR [LEN]    watchpoint on LEN bytes, 1 by default; unwatch ADDR [LEN]
+        when REG OP VALUE   condition such as "when v3 == 05" or "when i > 300"; unwhen clears them
+        key K 1|0           holds key K down or lets it go
+        regs                registers, timers and stack
+        mem ADDR [LEN]      hex dump, 64 bytes by default
+        dis [ADDR] [N]      disassemble N instructions from ADDR, 8 from pc by default
+        help, quit
+    Numbers are hex. continue and frame return DEBUG_RUNNING.
+*/
+debug_state_t debug_command(debugger_t* dbg, const char* line, FILE* out);
+
+// runs at most one frame of a continue or frame command, DEBUG_STOPPED and what stopped it on out once it ends
+debug_state_t debug_continue(debugger_t* dbg, FILE* out);
+
+// ends a continue early, printing where it got to
+void debug_interrupt(debugger_t* dbg, FILE* out);
+
+#endif
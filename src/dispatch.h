@@ -0,0 +1,612 @@
+/*
+    The interpreter's dispatch loop, included by intructions.c once per
+    quirk profile with RUN naming the function to define and QUIRKS the
+    profile's QUIRK_* flags as a constant, so every quirk test below folds
+    away and each profile gets its own loop with nothing checked per
+    instruction. TRACED 1 makes the copy where every handler appends its
+    instruction and the one value it wrote to active_trace (trace.h). No
+    include guard on purpose.
+*/
+
+#ifndef RUN
+    #error "define RUN, QUIRKS and TRACED before including dispatch.h"
+#endif
+
+static uint32_t RUN(chip8_t* chip, uint32_t count)
+{
+    static void* const dispatch[OP_COUNT] = {
+        [OP_NONE]       = &&op_decode,
+        [OP_CLS]        = &&op_cls,
+        [OP_RET]        = &&op_ret,
+        [OP_SYS]        = &&op_sys,
+        [OP_JP]         = &&op_jp,
+        [OP_CALL]       = &&op_call,
+        [OP_SE_VX_KK]   = &&op_se_vx_kk,
+        [OP_SNE_VX_KK]  = &&op_sne_vx_kk,
+        [OP_SE_VX_VY]   = &&op_se_vx_vy,
+        [OP_LD_VX_KK]   = &&op_ld_vx_kk,
+        [OP_ADD_VX_KK]  = &&op_add_vx_kk,
+        [OP_LD_VX_VY]   = &&op_ld_vx_vy,
+        [OP_OR]         = &&op_or,
+        [OP_AND]        = &&op_and,
+        [OP_XOR]        = &&op_xor,
+        [OP_ADD_VX_VY]  = &&op_add_vx_vy,
+        [OP_SUB]        = &&op_sub,
+        [OP_SHR]        = &&op_shr,
+        [OP_SUBN]       = &&op_subn,
+        [OP_SHL]        = &&op_shl,
+        [OP_SNE_VX_VY]  = &&op_sne_vx_vy,
+        [OP_LD_I]       = &&op_ld_i,
+        [OP_JP_V0]      = &&op_jp_v0,
+        [OP_RND]        = &&op_rnd,
+        [OP_DRW]        = &&op_drw,
+        [OP_SKP]        = &&op_skp,
+        [OP_SKNP]       = &&op_sknp,
+        [OP_LD_VX_DT]   = &&op_ld_vx_dt,
+        [OP_LD_VX_K]    = &&op_ld_vx_k,
+        [OP_LD_DT_VX]   = &&op_ld_dt_vx,
+        [OP_LD_ST_VX]   = &&op_ld_st_vx,
+        [OP_ADD_I_VX]   = &&op_add_i_vx,
+        [OP_LD_F_VX]    = &&op_ld_f_vx,
+        [OP_LD_B_VX]    = &&op_ld_b_vx,
+        [OP_LD_I_VX]    = &&op_ld_i_vx,
+        [OP_LD_VX_I]    = &&op_ld_vx_i,
+        [OP_UNKNOWN]    = &&op_unknown,
+    };
+    static void* const profiled[OP_COUNT] = {
+        [0 ... OP_COUNT - 1] = &&op_profile,
+    };
+
+    profile_t* const profile = active_profile;
+    trace_ring_t* const trace = TRACED ? active_trace : NULL;
+    // the ring's out and end, in registers while the loop runs
+    uint64_t* trace_out = NULL;
+    uint64_t* trace_end = NULL;
+    void* const* const table = profile ? profiled : dispatch;
+    uint8_t last_op = OP_NONE;
+    uint64_t last_tick = profile ? profile_ticks() : 0;
+
+    // instructions an idle loop, key wait or display wait left unrun, subtracted from count at the end
+    const uint32_t asked = count;
+    uint32_t skipped = 0;
+
+    uint8_t* const v = chip->v;
+    uint16_t pc = chip->pc;
+    decoded_t* d = NULL;
+    chip->idle = IDLE_NONE;
+    if (TRACED) {
+        trace_out = flush_trace(trace, trace->out, chip);
+        trace_end = trace->end;
+    }
+
+    // operands of the current instruction
+    #define X   (d->x)
+    #define Y   (d->y)
+    #define KK  (d->kk)
+    #define N   (d->kk & 0x0F)
+    #define NNN ((uint16_t)(d->x << 8 | d->kk))
+
+    // the instruction and what it wrote that play-trace can't work out from the registers before it, 0 for most
+    #define TRACE(value)                            \
+        do {                                        \
+            if (TRACED) {                           \
+                *trace_out++ = trace_word(d, (value)); \
+            }                                       \
+        } while (0)
+
+    #define DISPATCH()                              \
+        do {                                        \
+            if (count-- == 0) goto done;            \
+            pc &= 0xFFF;                            \
+            if (TRACED && trace_out >= trace_end) { \
+                trace_out = flush_trace(trace, trace_out, chip); \
+                trace_end = trace->end;             \
+            }                                       \
+            d = &chip->decoded[pc];                 \
+            pc += 2;                                \
+            goto *table[d->op];                     \
+        } while (0)
+
+    DISPATCH();
+
+    op_decode:
+    {
+        // cache miss, pc already points past the instruction
+        next(chip, pc - 2, d);
+        goto *table[d->op];
+    }
+
+    op_profile:
+    {
+        if (d->op == OP_NONE) goto op_decode;
+        const uint64_t now = profile_ticks();
+        charge(profile, last_op, now - last_tick);
+        profile->op_counts[d->op]++;
+        profile->pc_counts[(pc - 2) & 0xFFF]++;
+        last_op = d->op;
+        last_tick = now;
+        goto *dispatch[d->op];
+    }
+
+    /*
+        00E0 - CLS
+        Clear the display.
+    */
+    op_cls:
+    {
+        memset(&chip->display[0], 0, sizeof(chip->display));
+        chip->redraw = true;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    /*
+        00EE - RET
+        Return from a subroutine.
+        The interpreter sets the program counter to the address at the top of the stack,
+            then subtracts 1 from the stack pointer.
+    */
+    op_ret:
+    {
+        pc = chip->stack[chip->sp];
+        if (chip->sp > 0) chip->sp--;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    /*
+        0nnn - SYS addr
+        Jump to a machine code routine at nnn.
+        This instruction is only used on the old computers on which Chip-8 was originally implemented.
+             is ignored by modern interpreters.
+    */
+    op_sys:
+    {
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 1nnn - JP addr
+    // Jump to location nnn.
+
+    // The interpreter sets the program counter to nnn.
+    op_jp:
+    {
+        const uint16_t from = pc - 2;
+        pc = NNN;
+        // back over an Fx07 and a skip that won't, the registers can't change before the next tick
+        if (!profile && (pc == from || (pc == from - 4 && timer_poll(chip, pc)))) {
+            const uint32_t kept = count % (pc == from ? 1 : 3);
+            skipped += count - kept;
+            count = kept;
+            chip->idle = IDLE_LOOP;
+        }
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 2nnn - CALL addr
+    // Call subroutine at nnn.
+
+    // The interpreter increments the stack pointer, then puts the current PC on the top of the stack. The PC is then set to nnn.
+    op_call:
+    {
+        if (chip->sp < 11) chip->sp++;
+        chip->stack[chip->sp] = pc;
+        pc = NNN;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 3xkk - SE Vx, byte
+    // Skip next instruction if Vx = kk.
+
+    // The interpreter compares register Vx to kk, and if they are equal, increments the program counter by 2.
+    op_se_vx_kk:
+    {
+        if (v[X] == KK) pc += 2;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 4xkk - SNE Vx, byte
+    // Skip next instruction if Vx != kk.
+
+    // The interpreter compares register Vx to kk, and if they are not equal, increments the program counter by 2.
+    op_sne_vx_kk:
+    {
+        if (v[X] != KK) pc += 2;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 5xy0 - SE Vx, Vy
+    // Skip next instruction if Vx = Vy.
+
+    // The interpreter compares register Vx to register Vy, and if they are equal, increments the program counter by 2.
+    op_se_vx_vy:
+    {
+        if (v[X] == v[Y]) pc += 2;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 6xkk - LD Vx, byte
+    // Set Vx = kk.
+
+    // The interpreter puts the value kk into register Vx.
+    op_ld_vx_kk:
+    {
+        v[X] = KK;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 7xkk - ADD Vx, byte
+    // Set Vx = Vx + kk.
+
+    // Adds the value kk to the value of register Vx, then stores the result in Vx.
+    op_add_vx_kk:
+    {
+        v[X] += KK;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy0 - LD Vx, Vy
+    // Set Vx = Vy.
+
+    // Stores the value of register Vy in register Vx.
+    op_ld_vx_vy:
+    {
+        v[X] = v[Y];
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy1 - OR Vx, Vy
+    // Set Vx = Vx OR Vy.
+    op_or:
+    {
+        v[X] |= v[Y];
+        if (QUIRKS & QUIRK_VF_RESET) v[0xF] = 0;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy2 - AND Vx, Vy
+    // Set Vx = Vx AND Vy.
+    op_and:
+    {
+        v[X] &= v[Y];
+        if (QUIRKS & QUIRK_VF_RESET) v[0xF] = 0;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy3 - XOR Vx, Vy
+    // Set Vx = Vx XOR Vy.
+    op_xor:
+    {
+        v[X] ^= v[Y];
+        if (QUIRKS & QUIRK_VF_RESET) v[0xF] = 0;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy4 - ADD Vx, Vy
+    // Set Vx = Vx + Vy, set VF = carry.
+
+    // The values of Vx and Vy are added together. If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0. Only the lowest 8 bits of the result are kept, and stored in Vx.
+    op_add_vx_vy:
+    {
+        const uint16_t sum = v[X] + v[Y];
+        v[X] = sum;
+        v[0xF] = sum > 0xFF;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy5 - SUB Vx, Vy
+    // Set Vx = Vx - Vy, set VF = NOT borrow.
+
+    // If Vx >= Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx, and the results stored in Vx.
+    op_sub:
+    {
+        const uint8_t not_borrow = v[X] >= v[Y];
+        v[X] -= v[Y];
+        v[0xF] = not_borrow;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy6 - SHR Vx {, Vy}
+    // Set Vx = Vx SHR 1.
+
+    // If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
+    // QUIRK_SHIFT_VY shifts Vy into Vx instead, as the COSMAC VIP did.
+    op_shr:
+    {
+        const uint8_t source = QUIRKS & QUIRK_SHIFT_VY ? v[Y] : v[X];
+        v[X] = source >> 1;
+        v[0xF] = source & 0x01;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xy7 - SUBN Vx, Vy
+    // Set Vx = Vy - Vx, set VF = NOT borrow.
+
+    // If Vy >= Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
+    op_subn:
+    {
+        const uint8_t not_borrow = v[Y] >= v[X];
+        v[X] = v[Y] - v[X];
+        v[0xF] = not_borrow;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 8xyE - SHL Vx {, Vy}
+    // Set Vx = Vx SHL 1.
+
+    // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
+    // QUIRK_SHIFT_VY shifts Vy into Vx instead, as the COSMAC VIP did.
+    op_shl:
+    {
+        const uint8_t source = QUIRKS & QUIRK_SHIFT_VY ? v[Y] : v[X];
+        v[X] = source << 1;
+        v[0xF] = source >> 7;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // 9xy0 - SNE Vx, Vy
+    // Skip next instruction if Vx != Vy.
+
+    // The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
+    op_sne_vx_vy:
+    {
+        if (v[X] != v[Y]) pc += 2;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Annn - LD I, addr
+    // Set I = nnn.
+
+    // The value of register I is set to nnn.
+    op_ld_i:
+    {
+        chip->i = NNN;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Bnnn - JP V0, addr
+    // Jump to location nnn + V0.
+
+    // The program counter is set to nnn plus the value of V0.
+    // QUIRK_JUMP_VX reads it as Bxnn, xnn plus Vx, as SUPER-CHIP did.
+    op_jp_v0:
+    {
+        pc = NNN + v[QUIRKS & QUIRK_JUMP_VX ? X : 0];
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Cxkk - RND Vx, byte
+    // Set Vx = random byte AND kk.
+
+    // The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk. The results are stored in Vx. See instruction 8xy2 for more information on AND.
+    op_rnd:
+    {
+        v[X] = random_byte(chip) & KK;
+        TRACE(v[X]);
+        DISPATCH();
+    }
+
+    // Dxyn - DRW Vx, Vy, nibble
+    // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
+
+    // The interpreter reads n bytes from memory, starting at the address stored in I. These bytes are then displayed as sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen. If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0. The starting position wraps, the parts of a sprite past the right and bottom edges are clipped, or wrap around to the opposite side with QUIRK_WRAP. QUIRK_DISPLAY_WAIT ends the frame after a draw, the COSMAC VIP waited for the next vertical blank. See instruction 8xy3 for more information on XOR, and section 2.4, Display, for more information on the Chip-8 screen and sprites.
+    op_drw:
+    {
+        v[0x0F] = QUIRKS & QUIRK_WRAP ? wrap_sprite(chip, v[X], v[Y], chip->i, N) : draw_sprite(chip, v[X], v[Y], chip->i, N);
+        if (QUIRKS & QUIRK_DISPLAY_WAIT) {
+            skipped += count;
+            count = 0;
+        }
+        TRACE(v[0xF]);
+        DISPATCH();
+    }
+
+    // Ex9E - SKP Vx
+    // Skip next instruction if key with the value of Vx is pressed.
+
+    // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
+    op_skp:
+    {
+        chip->keys_read |= 1 << (v[X] & 0x0F);
+        if (chip->keypad[v[X] & 0x0F]) pc += 2;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // ExA1 - SKNP Vx
+    // Skip next instruction if key with the value of Vx is not pressed.
+
+    // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
+    op_sknp:
+    {
+        chip->keys_read |= 1 << (v[X] & 0x0F);
+        if (!chip->keypad[v[X] & 0x0F]) pc += 2;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Fx07 - LD Vx, DT
+    // Set Vx = delay timer value.
+
+    // The value of DT is placed into Vx.
+    op_ld_vx_dt:
+    {
+        v[X] = chip->delay_timer;
+        TRACE(v[X]);
+        DISPATCH();
+    }
+
+    // Fx0A - LD Vx, K
+    // Wait for a key press, store the value of the key in Vx.
+
+    // All execution stops until a key is pressed, then the value of that key is stored in Vx.
+    op_ld_vx_k:
+    {
+        uint8_t key = 0;
+        while (key < 16 && !chip->keypad[key]) key++;
+        if (key < 16) {
+            v[X] = key;
+            chip->keys_read |= 1 << key;
+        } else {
+            // no key down, run this instruction again
+            pc -= 2;
+            if (!profile) {
+                skipped += count;
+                count = 0;
+                chip->idle = IDLE_KEY;
+            }
+        }
+        TRACE(v[X]);
+        DISPATCH();
+    }
+
+    // Fx15 - LD DT, Vx
+    // Set delay timer = Vx.
+
+    // DT is set equal to the value of Vx.
+    op_ld_dt_vx:
+    {
+        chip->delay_timer = v[X];
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Fx18 - LD ST, Vx
+    // Set sound timer = Vx.
+
+    // ST is set equal to the value of Vx.
+    op_ld_st_vx:
+    {
+        chip->sound_timer = v[X];
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Fx1E - ADD I, Vx
+    // Set I = I + Vx.
+
+    // The values of I and Vx are added, and the results are stored in I.
+    op_add_i_vx:
+    {
+        chip->i += v[X];
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Fx29 - LD F, Vx
+    // Set I = location of sprite for digit Vx.
+
+    // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx. See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
+    op_ld_f_vx:
+    {
+        chip->i = (v[X] & 0x0F) * 5;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Fx33 - LD B, Vx
+    // Store BCD representation of Vx in memory locations I, I+1, and I+2.
+
+    // The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.
+    op_ld_b_vx:
+    {
+        const uint8_t value = v[X];
+        MEM(chip->i)     = value / 100;
+        MEM(chip->i + 1) = value / 10 % 10;
+        MEM(chip->i + 2) = value % 10;
+        invalidate_decoded(chip, chip->i, 3);
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Fx55 - LD [I], Vx
+    // Store registers V0 through Vx in memory starting at location I.
+
+    // The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
+    // QUIRK_LOAD_STORE_I leaves I just past the last one, as the COSMAC VIP did.
+    op_ld_i_vx:
+    {
+        for (uint8_t r = 0; r <= X; r++)
+        {
+            MEM(chip->i + r) = v[r];
+        }
+        invalidate_decoded(chip, chip->i, X + 1);
+        if (QUIRKS & QUIRK_LOAD_STORE_I) chip->i += X + 1;
+        TRACE(0);
+        DISPATCH();
+    }
+
+    // Fx65 - LD Vx, [I]
+    // Read registers V0 through Vx from memory starting at location I.
+
+    // The interpreter reads values from memory starting at location I into registers V0 through Vx.
+    // QUIRK_LOAD_STORE_I leaves I just past the last one, as the COSMAC VIP did.
+    op_ld_vx_i:
+    {
+        for (uint8_t r = 0; r <= X; r++)
+        {
+            v[r] = MEM(chip->i + r);
+        }
+        if (QUIRKS & QUIRK_LOAD_STORE_I) chip->i += X + 1;
+        TRACE(0);
+        if (TRACED) {
+            uint64_t registers[2];
+            memcpy(registers, v, sizeof(registers));
+            *trace_out++ = registers[0];
+            *trace_out++ = registers[1];
+        }
+        DISPATCH();
+    }
+
+    op_unknown:
+    {
+        printf("OPCODE %.2X%.2X not implemented\n", MEM(pc - 2), MEM(pc - 1));
+        if (TRACED) {
+            // the opcode in place of the value, decoded_t has only part of it
+            *trace_out++ = trace_word(d, MEM(pc - 2) << 8 | MEM(pc - 1));
+        }
+        DISPATCH();
+    }
+
+    done:
+    chip->pc = pc;
+    if (profile) {
+        charge(profile, last_op, profile_ticks() - last_tick);
+    }
+    if (TRACED) {
+        publish_trace(trace, trace_out);
+    }
+    return asked - skipped;
+
+    #undef X
+    #undef Y
+    #undef KK
+    #undef N
+    #undef NNN
+    #undef TRACE
+    #undef DISPATCH
+}
+
+#undef RUN
+#undef QUIRKS
+#undef TRACED
@@ -0,0 +1,141 @@
+#include "display.h"
+#include "audio.h"
+#include "chip8.h"
+
+#include <SDL.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+
+#define FG_COLOUR 0xFF00FF00
+#define BG_COLOUR 0xFF000000
+
+// samples per audio callback, about 5 ms at AUDIO_RATE
+#define AUDIO_SAMPLES 256
+
+
+sdl_t* init_sdl(config_t* config)
+{
+    sdl_t* sdl = calloc(1, sizeof(sdl_t));
+    sdl->config = config;
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0) {
+        SDL_Log("Failed to init SDL: %s\n", SDL_GetError());
+        return false;
+    }
+    sdl->window = SDL_CreateWindow(
+        "Chip8 Emulator",
+        SDL_WINDOWPOS_CENTERED,
+        SDL_WINDOWPOS_CENTERED,
+        WIDTH * sdl->config->scale_factor,
+        HEIGHT * sdl->config->scale_factor,
+        0);
+    if (!sdl->window) {
+        SDL_Log("Failed to create a window: %s\n", SDL_GetError());
+        return false;
+    }
+
+    // presents wait for vblank, they only hold up the thread drawing, not the emulator
+    const Uint32 flags = SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC;
+    sdl->renderer = SDL_CreateRenderer(sdl->window, -1, flags);
+    if (!sdl->renderer) {
+        SDL_Log("Failed to create a renderer: %s\n", SDL_GetError());
+        return false;
+    }
+
+    sdl->texture = SDL_CreateTexture(sdl->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, WIDTH, HEIGHT);
+    if (!sdl->texture) {
+        SDL_Log("Failed to create a texture: %s\n", SDL_GetError());
+        return false;
+    }
+    return sdl;
+}
+
+// runs on SDL's audio thread
+static void fill_audio(void* userdata, Uint8* stream, int len)
+{
+    render_audio(userdata, (int16_t*)stream, len / sizeof(int16_t));
+}
+
+bool init_sdl_audio(sdl_t* sdl, audio_t* audio)
+{
+    // no allowed changes, SDL converts if the device wants another format
+    SDL_AudioSpec want = {
+        .freq = AUDIO_RATE,
+        .format = AUDIO_S16SYS,
+        .channels = 1,
+        .samples = AUDIO_SAMPLES,
+        .callback = fill_audio,
+        .userdata = audio,
+    };
+    sdl->audio_device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0);
+    if (!sdl->audio_device) {
+        SDL_Log("Failed to open audio: %s\n", SDL_GetError());
+        return false;
+    }
+    SDL_PauseAudioDevice(sdl->audio_device, 0);
+    return true;
+}
+
+uint32_t changed_rows(const sdl_t* sdl, const uint64_t* display)
+{
+    if (!sdl->drawn) return UINT32_MAX;
+    uint32_t rows = 0;
+    for (uint8_t y = 0; y < HEIGHT; y++)
+    {
+        rows |= (uint32_t)(display[y] != sdl->shown[y]) << y;
+    }
+    return rows;
+}
+
+void draw(sdl_t *sdl, const uint64_t* display, uint32_t rows)
+{
+    uint32_t dirty = sdl->drawn ? rows : UINT32_MAX;
+
+    // convert dirty rows and upload each run of consecutive rows with one update,
+    // SDL_LockTexture would hand back undefined pixels for the rows we skip
+    while (dirty)
+    {
+        const uint8_t first = __builtin_ctz(dirty);
+        uint8_t last = first;
+        while (last + 1 < HEIGHT && (dirty >> (last + 1)) & 1) last++;
+
+        for (uint8_t y = first; y <= last; y++)
+        {
+            const uint64_t row = display[y];
+            sdl->shown[y] = row;
+            uint32_t* out = &sdl->pixels[y * WIDTH];
+            for (uint8_t x = 0; x < WIDTH; x++)
+            {
+                // fg colour when the pixel is on, bg colour when off
+                out[x] = (row >> (WIDTH - 1 - x)) & 1 ? FG_COLOUR : BG_COLOUR;
+            }
+        }
+
+        const SDL_Rect run = {.x = 0, .y = first, .w = WIDTH, .h = last - first + 1};
+        SDL_UpdateTexture(sdl->texture, &run, &sdl->pixels[first * WIDTH], WIDTH * sizeof(uint32_t));
+
+        // everything up to last is uploaded now
+        dirty = last + 1 < HEIGHT ? dirty & (UINT32_MAX << (last + 1)) : 0;
+    }
+    sdl->drawn = true;
+
+    SDL_RenderCopy(sdl->renderer, sdl->texture, NULL, NULL);
+    SDL_RenderPresent(sdl->renderer);
+}
+
+void close_sdl(sdl_t *sdl)
+{
+    if (sdl->audio_device) {
+        SDL_CloseAudioDevice(sdl->audio_device);
+    }
+    SDL_DestroyTexture( sdl->texture );
+    SDL_DestroyRenderer( sdl->renderer );
+
+    //Destroy window
+    SDL_DestroyWindow( sdl->window );
+
+    //Quit SDL subsystems
+    SDL_Quit();
+}
@@ -0,0 +1,47 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include "audio.h"
+#include "chip8.h"
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+
+typedef struct
+{
+    uint8_t scale_factor;
+    uint32_t ipf;   // instructions per 60 Hz frame
+    bool turbo;     // no frame pacing, run as fast as the host allows
+} config_t;
+
+typedef struct
+{
+    SDL_Window *window;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;           // WIDTH x HEIGHT streaming texture, scaled to the window by draw()
+    uint32_t pixels[WIDTH * HEIGHT]; // ARGB copy of the display, only dirty rows are rewritten
+    uint64_t shown[HEIGHT];         // display rows the texture holds
+    bool drawn;                     // false until the first draw() fills the texture
+    config_t* config;
+    SDL_AudioDeviceID audio_device; // 0 when running without sound
+} sdl_t;
+
+
+void PrintEvent(const SDL_Event *event, sdl_t *sdl);
+
+sdl_t *init_sdl(config_t *config);
+
+// starts the beeper on the default output, false (and silence) when there is none
+bool init_sdl_audio(sdl_t *sdl, audio_t *audio);
+
+// rows of display that differ from what the window shows, all of them before the first draw()
+uint32_t changed_rows(const sdl_t *sdl, const uint64_t *display);
+
+// uploads the given rows of display and presents, blocks until vblank
+void draw(sdl_t *sdl, const uint64_t *display, uint32_t rows);
+
+void close_sdl(sdl_t *sdl);
+
+#endif
@@ -0,0 +1,109 @@
+#include "chip8.h"
+#include "roms.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+    Writes the C for embedded_roms (roms.h), the roms compiled into every
+    binary. make embed runs it over EMBED_ROMS into src/embedded.c.
+
+    usage: play-embed [--output FILE] [rom ...]
+
+    Each rom is embedded under its file name, so a path ending in that
+    name loads it when the file isn't there.
+*/
+
+static void usage(const char* exe)
+{
+    fprintf(stderr, "usage: %s [--output FILE] [rom ...]\n", exe);
+}
+
+static const char* file_name(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static void write_escaped(FILE* out, const char* text)
+{
+    for (; *text; text++)
+    {
+        if (*text == '"' || *text == '\\') fputc('\\', out);
+        fputc(*text, out);
+    }
+}
+
+int main( int argc, char* args[] )
+{
+    const char* output = NULL;
+    const char* paths[256];
+    uint32_t count = 0;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(args[a], "--output") == 0 && a + 1 < argc) {
+            output = args[++a];
+        } else if (args[a][0] == '-' || count == 256) {
+            usage(args[0]);
+            return 1;
+        } else {
+            paths[count++] = args[a];
+        }
+    }
+
+    // everything is read before the output is opened, it may be the file this binary was built from
+    static uint8_t roms[256][MAX_ROM_SIZE + 1];
+    size_t sizes[256];
+    for (uint32_t n = 0; n < count; n++)
+    {
+        FILE* file = fopen(paths[n], "rb");
+        if (!file) {
+            fprintf(stderr, "Failed to open rom %s\n", paths[n]);
+            return 1;
+        }
+        sizes[n] = fread(roms[n], 1, sizeof(roms[n]), file);
+        fclose(file);
+        if (sizes[n] > MAX_ROM_SIZE) {
+            fprintf(stderr, "Rom file %s is too big! max allowed: %d.\n", paths[n], MAX_ROM_SIZE);
+            return 1;
+        }
+    }
+
+    FILE* out = output ? fopen(output, "w") : stdout;
+    if (!out) {
+        fprintf(stderr, "Failed to create %s\n", output);
+        return 1;
+    }
+
+    fprintf(out, "// roms compiled into the binary, written by play-embed: use make embed instead of editing\n\n");
+    fprintf(out, "#include \"roms.h\"\n\n#include <stdint.h>\n\n\n");
+    for (uint32_t n = 0; n < count; n++)
+    {
+        fprintf(out, "// %s\nstatic const uint8_t rom_%u[%zu] = {", paths[n], n, sizes[n] ? sizes[n] : 1);
+        for (size_t b = 0; b < sizes[n]; b++)
+        {
+            fprintf(out, "%s0x%.2X,", b % 12 ? " " : "\n    ", roms[n][b]);
+        }
+        fprintf(out, "\n};\n\n");
+    }
+
+    fprintf(out, "const rom_t embedded_roms[%u] = {\n", count ? count : 1);
+    for (uint32_t n = 0; n < count; n++)
+    {
+        fprintf(out, "    { \"");
+        write_escaped(out, file_name(paths[n]));
+        fprintf(out, "\", rom_%u, %zu, 0x%016llxULL },\n", n, sizes[n], (unsigned long long)hash_rom(roms[n], sizes[n]));
+    }
+    fprintf(out, "};\n\nconst uint32_t embedded_rom_count = %u;\n", count);
+
+    if (ferror(out) || (output && fclose(out) != 0)) {
+        fprintf(stderr, "Failed to write %s\n", output ? output : "embedded roms");
+        return 1;
+    }
+    return 0;
+}
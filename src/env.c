@@ -0,0 +1,151 @@
+#include "env.h"
+#include "chip8.h"
+#include "instructions.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+struct env
+{
+    chip8_t* machines;  // capacity of them, one block
+    chip8_t* initial;   // what reset_env() copies
+    float* rewards;
+    uint32_t capacity;
+    uint32_t size;
+    uint32_t ipf;
+    uint8_t source;     // reward_source_t
+    uint16_t index;
+};
+
+
+static env_t* init_env_from_chip(chip8_t* initial, uint32_t capacity, uint32_t ipf)
+{
+    if (!initial) {
+        return NULL;
+    }
+    env_t* env = calloc(1, sizeof(env_t));
+    // rounded up to whole lines, as aligned_alloc() wants
+    const size_t bytes = ((size_t)capacity * sizeof(chip8_t) + 63) / 64 * 64;
+    env->machines = capacity ? aligned_alloc(64, bytes) : NULL;
+    env->rewards = calloc(capacity, sizeof(float));
+    if (capacity && (!env->machines || !env->rewards)) {
+        fprintf(stderr, "Not enough memory for %u machines\n", capacity);
+        free(initial);
+        free(env->machines);
+        free(env->rewards);
+        free(env);
+        return NULL;
+    }
+    env->initial = initial;
+    env->capacity = capacity;
+    env->ipf = ipf ? ipf : INSTRUCTIONS_PER_FRAME;
+    return env;
+}
+
+static uint8_t reward_byte(const env_t* env, const chip8_t* chip)
+{
+    return env->source == REWARD_REGISTER ? chip->v[env->index] : chip->memory[env->index];
+}
+
+
+env_t* init_env(const char* rom_name, uint32_t capacity, uint32_t ipf)
+{
+    return init_env_from_chip(init_chip(rom_name), capacity, ipf);
+}
+
+env_t* init_env_from_memory(const uint8_t* rom, size_t rom_size, uint32_t capacity, uint32_t ipf)
+{
+    return init_env_from_chip(init_chip_from_memory(rom, rom_size), capacity, ipf);
+}
+
+void set_reward(env_t* env, reward_source_t source, uint16_t index)
+{
+    env->source = source;
+    env->index = source == REWARD_REGISTER ? index & 0x0F : index & 0xFFF;
+}
+
+bool reset_env(env_t* env, uint32_t n)
+{
+    if (n > env->capacity) {
+        fprintf(stderr, "Can't reset %u machines, room for %u\n", n, env->capacity);
+        return false;
+    }
+    for (uint32_t m = 0; m < n; m++)
+    {
+        chip8_t* chip = &env->machines[m];
+        memcpy(chip, env->initial, sizeof(chip8_t));
+        // distinct Cxkk sequences per machine, xorshift needs a non-zero state
+        chip->rng += m;
+        if (chip->rng == 0) chip->rng = 1;
+    }
+    memset(env->rewards, 0, n * sizeof(float));
+    env->size = n;
+    return true;
+}
+
+void step_env(env_t* env, const uint16_t* actions, uint32_t frames)
+{
+    for (uint32_t m = 0; m < env->size; m++)
+    {
+        chip8_t* chip = &env->machines[m];
+        for (uint8_t k = 0; k < 16; k++)
+        {
+            chip->keypad[k] = (actions[m] >> k) & 1;
+        }
+
+        int32_t reward = 0;
+        for (uint32_t f = 0; f < frames; f++)
+        {
+            if (env->source == REWARD_NONE) {
+                run_frame(chip, env->ipf);
+                continue;
+            }
+            const uint8_t before = reward_byte(env, chip);
+            run_frame(chip, env->ipf);
+            reward += (int8_t)(reward_byte(env, chip) - before);
+        }
+        env->rewards[m] = reward;
+    }
+}
+
+void observe_env(const env_t* env, uint8_t* pixels, float* rewards)
+{
+    if (rewards) {
+        memcpy(rewards, env->rewards, env->size * sizeof(float));
+    }
+    if (!pixels) return;
+    for (uint32_t m = 0; m < env->size; m++)
+    {
+        const chip8_t* chip = &env->machines[m];
+        for (uint8_t y = 0; y < HEIGHT; y++)
+        {
+            const uint64_t row = get_row(chip, y);
+            for (uint8_t x = 0; x < WIDTH; x++)
+            {
+                *pixels++ = (row >> (WIDTH - 1 - x)) & 1;
+            }
+        }
+    }
+}
+
+uint32_t env_size(const env_t* env)
+{
+    return env->size;
+}
+
+chip8_t* env_machine(env_t* env, uint32_t m)
+{
+    return &env->machines[m];
+}
+
+void close_env(env_t* env)
+{
+    free(env->machines);
+    free(env->initial);
+    free(env->rewards);
+    free(env);
+}
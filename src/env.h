@@ -0,0 +1,64 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+    Batched machines for training and search harnesses, the API of
+    libchip8.so (make shared). All memory is allocated by init_env():
+    reset_env(), step_env() and observe_env() never allocate, and
+    observations are written straight into the caller's buffers.
+
+    One env is single threaded. Harnesses that want more cores run one env
+    per thread.
+
+    The library is built with -fvisibility=hidden, ENV_API marks the only
+    symbols it exports.
+*/
+#define ENV_API __attribute__((visibility("default")))
+
+typedef struct env env_t;
+
+// what a machine's reward counts, see set_reward()
+typedef enum {
+    REWARD_NONE = 0,    // always 0
+    REWARD_REGISTER,    // change of Vx over a step, index is x
+    REWARD_MEMORY,      // change of memory[addr] over a step, index is addr
+} reward_source_t;
+
+// room for capacity machines running rom, ipf = 0 runs INSTRUCTIONS_PER_FRAME per frame
+ENV_API env_t* init_env(const char* rom_name, uint32_t capacity, uint32_t ipf);
+
+// same as init_env() for a rom image already in memory
+ENV_API env_t* init_env_from_memory(const uint8_t* rom, size_t rom_size, uint32_t capacity, uint32_t ipf);
+
+// REWARD_NONE until set; counted per frame as a signed byte, so 0xFF to 0x02 is 3 and 5 to 4 is -1
+ENV_API void set_reward(env_t* env, reward_source_t source, uint16_t index);
+
+// starts n fresh machines, machine m with rng seed base + m like init_pool(); false when n is over capacity
+ENV_API bool reset_env(env_t* env, uint32_t n);
+
+// holds down the keys in actions[m] (bit k for key k) on machine m for frames 60 Hz frames
+ENV_API void step_env(env_t* env, const uint16_t* actions, uint32_t frames);
+
+/*
+    Machine m's display into pixels[m * HEIGHT * WIDTH + y * WIDTH + x],
+    1 when lit, and the reward of its last step into rewards[m]. Either
+    buffer may be NULL.
+*/
+ENV_API void observe_env(const env_t* env, uint8_t* pixels, float* rewards);
+
+// machines started by the last reset_env()
+ENV_API uint32_t env_size(const env_t* env);
+
+// direct access to machine m, e.g. to read its registers between steps
+ENV_API chip8_t* env_machine(env_t* env, uint32_t m);
+
+ENV_API void close_env(env_t* env);
+
+#endif
@@ -0,0 +1,161 @@
+#include "fork.h"
+#include "arena.h"
+#include "chip8.h"
+#include "instructions.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// chip8_t.written_pages bits covering one fork page
+#define WRITTEN_BITS (FORK_PAGE_SIZE / 64)
+
+struct chip8_fork
+{
+    const uint8_t* pages[FORK_PAGES];
+
+    // everything in chip8_t before the caches, memory aside
+    uint64_t display[HEIGHT];
+    uint16_t stack[12];
+    uint8_t sp;
+    uint8_t v[16];
+    uint16_t i;
+    uint16_t pc;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    bool keypad[16];
+    uint32_t rng;
+    uint8_t quirks;
+};
+
+// the pages the last machine entered on this thread holds, valid while no arena has been reset
+// and the machine still carries the stamp it got then: a machine freed and allocated again at
+// the same address, reset, or copied over has another
+static _Thread_local struct
+{
+    const chip8_t* chip;
+    uint64_t stamp;
+    uint64_t resets;
+    const uint8_t* pages[FORK_PAGES];
+} held;
+
+// last fork_stamp handed out, on any thread
+static uint64_t stamps;
+
+
+static void save_registers(chip8_fork_t* fork, const chip8_t* chip)
+{
+    memcpy(fork->display, chip->display, sizeof(fork->display));
+    memcpy(fork->stack, chip->stack, sizeof(fork->stack));
+    fork->sp = chip->sp;
+    memcpy(fork->v, chip->v, sizeof(fork->v));
+    fork->i = chip->i;
+    fork->pc = chip->pc;
+    fork->delay_timer = chip->delay_timer;
+    fork->sound_timer = chip->sound_timer;
+    memcpy(fork->keypad, chip->keypad, sizeof(fork->keypad));
+    fork->rng = chip->rng;
+    fork->quirks = chip->quirks;
+}
+
+static bool page_written(const chip8_t* chip, uint8_t page)
+{
+    return (chip->written_pages >> (page * WRITTEN_BITS)) & ((1u << WRITTEN_BITS) - 1);
+}
+
+
+chip8_fork_t* fork_root(arena_t* arena, const chip8_t* chip)
+{
+    chip8_fork_t* fork = arena_alloc(arena, sizeof(chip8_fork_t));
+    uint8_t* pages = arena_alloc(arena, sizeof(chip->memory));
+    if (!fork || !pages) {
+        return NULL;
+    }
+    memcpy(pages, chip->memory, sizeof(chip->memory));
+    for (uint8_t p = 0; p < FORK_PAGES; p++)
+    {
+        fork->pages[p] = &pages[p * FORK_PAGE_SIZE];
+    }
+    save_registers(fork, chip);
+    return fork;
+}
+
+chip8_fork_t* chip8_fork(arena_t* arena, const chip8_fork_t* parent)
+{
+    chip8_fork_t* fork = arena_alloc(arena, sizeof(chip8_fork_t));
+    if (!fork) {
+        return NULL;
+    }
+    // pages are immutable, the pointers are all a child needs
+    memcpy(fork, parent, sizeof(chip8_fork_t));
+    return fork;
+}
+
+void enter_fork(chip8_t* chip, const chip8_fork_t* fork)
+{
+    const uint64_t resets = arena_resets();
+    const bool known = held.chip == chip && held.stamp == chip->fork_stamp && chip->fork_stamp != 0 && held.resets == resets;
+
+    for (uint8_t p = 0; p < FORK_PAGES; p++)
+    {
+        // a page written outside a fork is no longer the one held
+        if (!known || held.pages[p] != fork->pages[p] || page_written(chip, p)) {
+            memcpy(&chip->memory[p * FORK_PAGE_SIZE], fork->pages[p], FORK_PAGE_SIZE);
+            invalidate_decoded(chip, p * FORK_PAGE_SIZE, FORK_PAGE_SIZE);
+            held.pages[p] = fork->pages[p];
+        }
+    }
+    held.chip = chip;
+    held.stamp = chip->fork_stamp = __atomic_add_fetch(&stamps, 1, __ATOMIC_RELAXED);
+    held.resets = resets;
+    chip->written_pages = 0;
+
+    memcpy(chip->display, fork->display, sizeof(chip->display));
+    memcpy(chip->stack, fork->stack, sizeof(chip->stack));
+    chip->sp = fork->sp;
+    memcpy(chip->v, fork->v, sizeof(chip->v));
+    chip->i = fork->i;
+    chip->pc = fork->pc;
+    chip->delay_timer = fork->delay_timer;
+    chip->sound_timer = fork->sound_timer;
+    memcpy(chip->keypad, fork->keypad, sizeof(chip->keypad));
+    chip->rng = fork->rng;
+    chip->quirks = fork->quirks;
+
+    chip->idle = IDLE_NONE;
+    chip->redraw = true;
+}
+
+bool leave_fork(chip8_t* chip, chip8_fork_t* fork, arena_t* arena)
+{
+    // every copy is made before the fork changes, so running out leaves it as it was
+    const uint8_t* pages[FORK_PAGES];
+    memcpy(pages, fork->pages, sizeof(pages));
+    for (uint8_t p = 0; p < FORK_PAGES; p++)
+    {
+        if (!page_written(chip, p)) continue;
+        // the bits also cover the byte before each write, the page may be unchanged
+        if (memcmp(&chip->memory[p * FORK_PAGE_SIZE], fork->pages[p], FORK_PAGE_SIZE) == 0) continue;
+        uint8_t* page = arena_alloc(arena, FORK_PAGE_SIZE);
+        if (!page) {
+            return false;
+        }
+        memcpy(page, &chip->memory[p * FORK_PAGE_SIZE], FORK_PAGE_SIZE);
+        pages[p] = page;
+    }
+    memcpy(fork->pages, pages, sizeof(pages));
+    save_registers(fork, chip);
+
+    // chip holds exactly the fork's pages now
+    if (held.chip == chip && held.stamp == chip->fork_stamp && held.resets == arena_resets()) {
+        memcpy(held.pages, fork->pages, sizeof(held.pages));
+        chip->written_pages = 0;
+    }
+    return true;
+}
+
+const uint8_t* fork_page(const chip8_fork_t* fork, uint8_t page)
+{
+    return fork->pages[page % FORK_PAGES];
+}
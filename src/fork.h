@@ -0,0 +1,49 @@
+#ifndef FORK_H
+#define FORK_H
+
+#include "arena.h"
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+#define FORK_PAGE_SIZE 256
+#define FORK_PAGES (4096 / FORK_PAGE_SIZE)
+
+/*
+    Forks for search and fuzzing: one machine branched into many at a
+    decision point. A fork keeps its own registers, timers, keypad and
+    display, and points at 256-byte memory pages it shares with its parent
+    and siblings. Pages never change once written, so sharing them is
+    copy-on-write: a fork that stores to memory gets new copies of just the
+    pages it wrote.
+
+    A fork runs by entering it into a working machine, which copies in only
+    the pages the machine doesn't already hold from an earlier fork, and
+    leaving it again afterwards. Forks and their pages live in an arena and
+    go away with reset_arena(). Run forks on the interpreter: the jit and
+    aot consume chip8_t.written_pages, which leave_fork() relies on.
+*/
+typedef struct chip8_fork chip8_fork_t;
+
+// a root fork holding chip's current state
+chip8_fork_t* fork_root(arena_t* arena, const chip8_t* chip);
+
+// a child of parent, sharing every one of its pages
+chip8_fork_t* chip8_fork(arena_t* arena, const chip8_fork_t* parent);
+
+// makes chip the fork's machine, on the calling thread; after a new machine or a copy over chip every page is copied in
+void enter_fork(chip8_t* chip, const chip8_fork_t* fork);
+
+/*
+    Stores chip back into the fork it entered, pages written since get
+    copies in arena. False when the arena runs out, the fork is then left
+    as it was and chip still counts as written, entering any fork recopies.
+*/
+bool leave_fork(chip8_t* chip, chip8_fork_t* fork, arena_t* arena);
+
+// the fork's copy of memory[page * FORK_PAGE_SIZE], shared with any fork that returns the same pointer
+const uint8_t* fork_page(const chip8_fork_t* fork, uint8_t page);
+
+#endif
@@ -0,0 +1,63 @@
+#include "frames.h"
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// set in middle when the slot it names was published after the consumer last looked
+#define FRESH 4
+
+struct frames
+{
+    _Alignas(64) frame_t slots[3];
+
+    // exchanged by both sides: index of the slot in the middle, | FRESH
+    _Alignas(64) uint8_t middle;
+
+    _Alignas(64) uint8_t back;      // producer's
+    uint64_t published;
+    _Alignas(64) uint8_t front;     // consumer's
+};
+
+
+frames_t* init_frames()
+{
+    frames_t* frames = aligned_alloc(64, sizeof(frames_t));
+    if (!frames) {
+        return NULL;
+    }
+    memset(frames, 0, sizeof(frames_t));
+    frames->back = 0;
+    frames->middle = 1;
+    frames->front = 2;
+    return frames;
+}
+
+frame_t* back_frame(frames_t* frames)
+{
+    return &frames->slots[frames->back];
+}
+
+void publish_frame(frames_t* frames)
+{
+    frames->slots[frames->back].number = ++frames->published;
+    const uint8_t old = __atomic_exchange_n(&frames->middle, frames->back | FRESH, __ATOMIC_ACQ_REL);
+    frames->back = old & 3;
+}
+
+const frame_t* latest_frame(frames_t* frames)
+{
+    if (__atomic_load_n(&frames->middle, __ATOMIC_RELAXED) & FRESH) {
+        const uint8_t old = __atomic_exchange_n(&frames->middle, frames->front, __ATOMIC_ACQ_REL);
+        frames->front = old & 3;
+    }
+    const frame_t* frame = &frames->slots[frames->front];
+    return frame->number ? frame : NULL;
+}
+
+void close_frames(frames_t* frames)
+{
+    free(frames);
+}
@@ -0,0 +1,40 @@
+#ifndef FRAMES_H
+#define FRAMES_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+// one finished frame as the emulator thread hands it to the renderer
+typedef struct
+{
+    uint64_t display[HEIGHT];
+    uint64_t number;        // counts up from 1 with every publish_frame()
+    uint64_t read_at[16];   // latency_now() when key k was first read since it last changed, 0 when not yet
+} frame_t;
+
+/*
+    Lock-free triple buffer between one producer and one consumer. The
+    producer fills back_frame() and publishes it, the consumer takes the
+    newest published frame; each side owns one slot and they swap the third
+    through a single atomic exchange, so neither ever waits for the other.
+    Frames published faster than they are taken are overwritten, the
+    consumer only ever sees the latest.
+*/
+typedef struct frames frames_t;
+
+frames_t* init_frames();
+
+// producer: the slot to fill next, its contents are stale
+frame_t* back_frame(frames_t* frames);
+
+// producer: makes the back slot the newest frame and takes over a free one
+void publish_frame(frames_t* frames);
+
+// consumer: the newest frame published, the same one again when nothing new came, NULL before the first
+const frame_t* latest_frame(frames_t* frames);
+
+void close_frames(frames_t* frames);
+
+#endif
@@ -0,0 +1,506 @@
+#include "chip8.h"
+#include "instructions.h"
+#include "aot.h"
+#include "audio.h"
+#include "batch.h"
+#include "debugger.h"
+#include "jit.h"
+#include "movie.h"
+#include "pool.h"
+#include "profile.h"
+#include "roms.h"
+#include "state.h"
+#include "test.h"
+#include "trace.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+
+/*
+    Runs a rom without a window. Used on build boxes for throughput
+    measurements and batch jobs, links against the core only.
+
+    usage: play-headless [--instructions N | --frames N] [--ipf N] [--jit | --aot]
+                         [--instances N [--threads N] | --lockstep N]
+                         [--load-state FILE] [--save-state FILE]
+                         [--seed N] [--replay FILE] [--profile]
+                         [--rom-dir DIR] [--list-roms] [--wav FILE]
+                         [--quirks modern|vip|schip|xochip] [--trace FILE] [--debug] [rom]
+
+    --frames runs N 60 Hz frames of --ipf instructions each and ticks the
+    timers once per frame, --instructions runs N instructions with no timers.
+    --instances runs N copies of the rom on a thread pool (by frames, the
+    interpreter only) and prints a result line per instance. --lockstep runs
+    N copies (up to LANES) in one thread with the vector lockstep interpreter.
+    --load-state resumes a single machine from a save state before running,
+    --save-state writes one when the run ends. --seed sets the Cxkk seed,
+    --replay plays back a movie recorded by play --record with its seed and
+    ipf, unthrottled, for as many frames as it holds unless --frames is given.
+    --profile counts instructions per opcode and pc on a single interpreted
+    machine (no --jit) and prints a hot-spot report to stderr at the end.
+    --aot runs the rom translated ahead of time by make aot, which builds
+    play-aot and makes its rom the default.
+    --rom-dir reads every rom in DIR up front, after which rom may also be a
+    file name or content hash from that directory. --list-roms prints the
+    hash, size and name of every rom known, embedded ones included.
+    --wav writes the beeper to FILE as 16-bit mono at AUDIO_RATE, one
+    frame of samples per frame run, and so implies running by frames.
+    --quirks picks the interpreter's quirk profile (chip8.h), modern by
+    default and the only one --jit, --aot, --instances and --lockstep run.
+    --trace writes a record per instruction of a single interpreted machine
+    (no --jit or --aot) to FILE, play-trace (make trace) prints it as text.
+    --debug runs the rom under the debugger (debugger.h) instead, reading
+    commands from stdin; ctrl-c stops a continue.
+*/
+
+#ifdef AOT
+    extern const aot_program_t aot_program;
+#endif
+
+static void usage(const char* exe)
+{
+    fprintf(stderr, "usage: %s [--instructions N | --frames N] [--ipf N] [--jit | --aot] [--instances N [--threads N] | --lockstep N] [--load-state FILE] [--save-state FILE] [--seed N] [--replay FILE] [--profile] [--rom-dir DIR] [--list-roms] [--wav FILE] [--quirks modern|vip|schip|xochip] [--trace FILE] [--debug] [rom]\n", exe);
+}
+
+static double now_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void print_instance(uint32_t n, uint64_t instructions, uint16_t pc, uint16_t i, const uint8_t* v, uint64_t hash)
+{
+    printf("instance %u: instructions %llu pc %.3X i %.3X display hash %016llx v",
+        n, (unsigned long long)instructions, pc, i, (unsigned long long)hash);
+    for (uint8_t r = 0; r < 16; r++)
+    {
+        printf(" %.2X", v[r]);
+    }
+    printf("\n");
+}
+
+static bool load_state_file(chip8_t* chip, const char* path)
+{
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open save state %s\n", path);
+        return false;
+    }
+    state_t state;
+    const bool ok = read_state(&state, file);
+    fclose(file);
+    if (ok) {
+        load_state(chip, &state);
+    }
+    return ok;
+}
+
+static bool save_state_file(chip8_t* chip, const char* path)
+{
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        fprintf(stderr, "Failed to create save state %s\n", path);
+        return false;
+    }
+    state_t state;
+    save_state(chip, &state);
+    const bool ok = write_state(&state, file);
+    return fclose(file) == 0 && ok;
+}
+
+static int run_lockstep(const char* rom_name, uint32_t lanes, uint64_t frames, uint32_t ipf)
+{
+    batch_t* batch = init_batch(rom_name, lanes);
+    if (!batch) {
+        return 1;
+    }
+
+    const double start = now_seconds();
+    for (uint64_t f = 0; f < frames; f++)
+    {
+        run_batch_frame(batch, ipf);
+    }
+    const double elapsed = now_seconds() - start;
+
+    const uint64_t instructions = frames * ipf;
+    for (uint32_t l = 0; l < lanes; l++)
+    {
+        chip8_t* chip = batch_lane(batch, l);
+        print_instance(l, instructions, chip->pc, chip->i, chip->v, hash_display(chip));
+    }
+
+    printf("rom: %s\n", rom_name);
+    printf("lanes: %u\n", lanes);
+    printf("frames: %llu\n", (unsigned long long)frames);
+    printf("instructions: %llu\n", (unsigned long long)instructions * lanes);
+    printf("seconds: %.6f\n", elapsed);
+    printf("instructions/sec: %.0f\n", elapsed > 0 ? instructions * lanes / elapsed : 0.0);
+    close_batch(batch);
+    return 0;
+}
+
+static int run_many(const char* rom_name, uint32_t instances, uint32_t threads, uint64_t frames, uint32_t ipf)
+{
+    pool_t* pool = init_pool(rom_name, instances, threads);
+    if (!pool) {
+        return 1;
+    }
+
+    const double start = now_seconds();
+    run_pool(pool, frames, ipf);
+    const double elapsed = now_seconds() - start;
+
+    uint64_t instructions = 0;
+    for (uint32_t n = 0; n < instances; n++)
+    {
+        instance_result_t result;
+        pool_result(pool, n, &result);
+        instructions += result.instructions;
+
+        print_instance(n, result.instructions, result.pc, result.i, result.v, result.display_hash);
+    }
+
+    printf("rom: %s\n", rom_name);
+    printf("instances: %u\n", instances);
+    printf("threads: %u\n", pool_threads(pool));
+    printf("frames: %llu\n", (unsigned long long)frames);
+    printf("instructions: %llu\n", (unsigned long long)instructions);
+    printf("seconds: %.6f\n", elapsed);
+    printf("instructions/sec: %.0f\n", elapsed > 0 ? instructions / elapsed : 0.0);
+    close_pool(pool);
+    return 0;
+}
+
+static volatile sig_atomic_t interrupted = 0;
+
+static void interrupt(int sig)
+{
+    interrupted = 1;
+}
+
+// debugger commands from stdin until quit or end of input
+static int run_debugger(chip8_t* chip, uint32_t ipf)
+{
+    debugger_t* dbg = init_debugger(chip, ipf);
+    if (!dbg) {
+        return 1;
+    }
+    signal(SIGINT, interrupt);
+    printf("help lists the commands\n");
+
+    char line[128];
+    debug_state_t state = DEBUG_STOPPED;
+    while (state != DEBUG_QUIT)
+    {
+        if (state == DEBUG_RUNNING) {
+            if (interrupted) {
+                debug_interrupt(dbg, stdout);
+                state = DEBUG_STOPPED;
+            } else {
+                state = debug_continue(dbg, stdout);
+            }
+            continue;
+        }
+        printf("(chip8) ");
+        fflush(stdout);
+        interrupted = 0;
+        if (!fgets(line, sizeof(line), stdin)) {
+            break;
+        }
+        state = debug_command(dbg, line, stdout);
+    }
+    close_debugger(dbg);
+    return 0;
+}
+
+
+int main( int argc, char* args[] )
+{
+    #ifdef TEST
+        return test_all() ? 0 : 1;
+    #endif
+
+    #ifdef AOT
+        const char* rom_name = aot_program.rom_name;
+    #else
+        const char* rom_name = "roms/IBM Logo.ch8";
+    #endif
+    uint64_t instructions = 1000000;
+    uint64_t frames = 0;
+    uint32_t ipf = INSTRUCTIONS_PER_FRAME;
+    bool use_jit = false;
+    bool use_aot = false;
+    uint32_t instances = 0;
+    uint32_t threads = 0;
+    uint32_t lockstep = 0;
+    const char* load_path = NULL;
+    const char* save_path = NULL;
+    const char* replay_path = NULL;
+    uint32_t seed = 0;
+    bool profiling = false;
+    const char* rom_dir = NULL;
+    bool list_roms = false;
+    const char* wav_path = NULL;
+    quirks_t quirks = QUIRKS_MODERN;
+    const char* trace_path = NULL;
+    bool debugging = false;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(args[a], "--instructions") == 0 && a + 1 < argc) {
+            instructions = strtoull(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--frames") == 0 && a + 1 < argc) {
+            frames = strtoull(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--ipf") == 0 && a + 1 < argc) {
+            ipf = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--jit") == 0) {
+            use_jit = true;
+        } else if (strcmp(args[a], "--aot") == 0) {
+            use_aot = true;
+        } else if (strcmp(args[a], "--instances") == 0 && a + 1 < argc) {
+            instances = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--threads") == 0 && a + 1 < argc) {
+            threads = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--lockstep") == 0 && a + 1 < argc) {
+            lockstep = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--load-state") == 0 && a + 1 < argc) {
+            load_path = args[++a];
+        } else if (strcmp(args[a], "--save-state") == 0 && a + 1 < argc) {
+            save_path = args[++a];
+        } else if (strcmp(args[a], "--seed") == 0 && a + 1 < argc) {
+            seed = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--replay") == 0 && a + 1 < argc) {
+            replay_path = args[++a];
+        } else if (strcmp(args[a], "--profile") == 0) {
+            profiling = true;
+        } else if (strcmp(args[a], "--rom-dir") == 0 && a + 1 < argc) {
+            rom_dir = args[++a];
+        } else if (strcmp(args[a], "--list-roms") == 0) {
+            list_roms = true;
+        } else if (strcmp(args[a], "--wav") == 0 && a + 1 < argc) {
+            wav_path = args[++a];
+        } else if (strcmp(args[a], "--quirks") == 0 && a + 1 < argc) {
+            quirks = find_quirks(args[++a]);
+            if (quirks == QUIRKS_COUNT) {
+                fprintf(stderr, "Unknown quirk profile %s\n", args[a]);
+                return 1;
+            }
+        } else if (strcmp(args[a], "--trace") == 0 && a + 1 < argc) {
+            trace_path = args[++a];
+        } else if (strcmp(args[a], "--debug") == 0) {
+            debugging = true;
+        } else if (args[a][0] == '-') {
+            usage(args[0]);
+            return 1;
+        } else {
+            rom_name = args[a];
+        }
+    }
+
+    #ifndef AOT
+        if (use_aot) {
+            fprintf(stderr, "No rom translated into this build, make aot builds play-aot\n");
+            return 1;
+        }
+    #endif
+
+    if (rom_dir) {
+        add_rom_dir(shared_roms(), rom_dir);
+    }
+    if (list_roms) {
+        const rom_library_t* library = shared_roms();
+        for (uint32_t n = 0; n < rom_count(library); n++)
+        {
+            const rom_t* rom = rom_at(library, n);
+            printf("%016llx %5zu %s\n", (unsigned long long)rom->hash, rom->size, rom->name);
+        }
+        return 0;
+    }
+
+    if ((lockstep > 0 || instances > 0) && quirks != QUIRKS_MODERN) {
+        fprintf(stderr, "--instances and --lockstep only run the modern quirk profile\n");
+        return 1;
+    }
+    if (lockstep > 0) {
+        return run_lockstep(rom_name, lockstep, frames > 0 ? frames : instructions / ipf, ipf);
+    }
+    if (instances > 0) {
+        return run_many(rom_name, instances, threads, frames > 0 ? frames : instructions / ipf, ipf);
+    }
+
+    chip8_t* chip = init_chip(rom_name);
+    if (!chip) {
+        return 1;
+    }
+    if (seed != 0) {
+        chip->rng = seed;
+    }
+    chip->quirks = quirks;
+    if (load_path && !load_state_file(chip, load_path)) {
+        return 1;
+    }
+    if (debugging) {
+        return run_debugger(chip, ipf);
+    }
+
+    movie_t* movie = NULL;
+    if (replay_path) {
+        FILE* file = fopen(replay_path, "rb");
+        if (!file) {
+            fprintf(stderr, "Failed to open movie %s\n", replay_path);
+            return 1;
+        }
+        movie = read_movie(file);
+        fclose(file);
+        if (!movie) {
+            return 1;
+        }
+        chip->rng = movie_seed(movie);
+        ipf = movie_ipf(movie);
+        if (frames == 0) frames = movie_frames(movie);
+    }
+
+    // falls back to the interpreter when the host can't run translated code
+    // a profile or trace needs every instruction to go through the interpreter
+    const bool interpret = profiling || trace_path;
+    jit_t* jit = use_jit && !interpret ? init_jit(chip) : NULL;
+
+    aot_t* aot = NULL;
+    #ifdef AOT
+        if (use_aot && !interpret) {
+            aot = init_aot(chip, &aot_program);
+            if (aot && aot_valid_blocks(aot) == 0) {
+                fprintf(stderr, "%s doesn't match the translated %s, interpreting\n", rom_name, aot_program.rom_name);
+            }
+        }
+    #endif
+
+    // the beeper's samples go straight to the file, a frame at a time
+    FILE* wav = NULL;
+    audio_t* audio = NULL;
+    int16_t samples[AUDIO_RATE / FRAME_RATE];
+    uint32_t wav_samples = 0;
+    if (wav_path) {
+        wav = fopen(wav_path, "wb");
+        if (!wav) {
+            fprintf(stderr, "Failed to create %s\n", wav_path);
+            return 1;
+        }
+        audio = init_audio(AUDIO_RATE);
+        if (!audio || !write_wav_header(wav, AUDIO_RATE, 0)) {
+            return 1;
+        }
+        if (frames == 0) frames = instructions / ipf;
+    }
+
+    FILE* trace_file = NULL;
+    trace_t* trace = NULL;
+    if (trace_path) {
+        trace_file = fopen(trace_path, "wb");
+        if (!trace_file) {
+            fprintf(stderr, "Failed to create %s\n", trace_path);
+            return 1;
+        }
+        trace = init_trace(trace_file);
+        if (!trace || !start_trace(trace)) {
+            return 1;
+        }
+    }
+
+    profile_t* profile = profiling ? calloc(1, sizeof(profile_t)) : NULL;
+    if (profile) {
+        start_profile(profile);
+    }
+
+    // what really ran, idle loops the interpreter skipped don't count towards the rate
+    uint64_t executed = 0;
+    const double start = now_seconds();
+    if (frames > 0) {
+        for (uint64_t f = 0; f < frames; f++)
+        {
+            if (movie) {
+                play_frame(movie, chip);
+            }
+            if (aot) {
+                executed += run_aot(aot, ipf);
+                tick_timers(chip);
+            } else if (jit) {
+                executed += run_jit(jit, ipf);
+                tick_timers(chip);
+            } else {
+                executed += run_frame(chip, ipf);
+            }
+            if (audio) {
+                audio_frame(audio, chip);
+                render_audio(audio, samples, sizeof(samples) / sizeof(samples[0]));
+                wav_samples += fwrite(samples, sizeof(samples[0]), sizeof(samples) / sizeof(samples[0]), wav);
+            }
+        }
+    } else if (!aot && !jit) {
+        executed = run_budget(chip, instructions);
+    } else {
+        // the translated cores only run the modern profile, no display wait ends a call early
+        for (uint64_t n = instructions; n > 0; )
+        {
+            const uint32_t step = n > UINT32_MAX ? UINT32_MAX : n;
+            if (aot) {
+                executed += run_aot(aot, step);
+            } else {
+                executed += run_jit(jit, step);
+            }
+            n -= step;
+        }
+    }
+    const double elapsed = now_seconds() - start;
+    if (profile) {
+        stop_profile();
+        print_profile(profile, stderr, 20);
+        free(profile);
+    }
+    if (trace) {
+        stop_trace();
+        close_trace(trace);
+        if (fclose(trace_file) != 0) {
+            fprintf(stderr, "Failed to write %s\n", trace_path);
+            return 1;
+        }
+    }
+
+    printf("rom: %s\n", rom_name);
+    printf("instructions: %llu\n", (unsigned long long)executed);
+    printf("seconds: %.6f\n", elapsed);
+    printf("instructions/sec: %.0f\n", elapsed > 0 ? executed / elapsed : 0.0);
+    if (frames > 0) {
+        printf("frames: %llu\n", (unsigned long long)frames);
+        printf("frames/sec: %.0f\n", elapsed > 0 ? frames / elapsed : 0.0);
+    }
+    printf("display hash: %016llx\n", (unsigned long long)hash_display(chip));
+    if (jit) {
+        close_jit(jit);
+    }
+    if (aot) {
+        close_aot(aot);
+    }
+    if (movie) {
+        close_movie(movie);
+    }
+    if (wav) {
+        close_audio(audio);
+        // the header goes in again now the length is known
+        const bool written = fseek(wav, 0, SEEK_SET) == 0 && write_wav_header(wav, AUDIO_RATE, wav_samples);
+        if (fclose(wav) != 0 || !written) {
+            return 1;
+        }
+    }
+    if (save_path && !save_state_file(chip, save_path)) {
+        return 1;
+    }
+    return 0;
+}
@@ -3,10 +3,81 @@
 
 #include "chip8.h"
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 
+// dispatch indices stored in decoded_t.op
+typedef enum {
+    OP_NONE = 0,    // slot not decoded yet
+    OP_CLS,         // 00E0
+    OP_RET,         // 00EE
+    OP_SYS,         // 0nnn
+    OP_JP,          // 1nnn
+    OP_CALL,        // 2nnn
+    OP_SE_VX_KK,    // 3xkk
+    OP_SNE_VX_KK,   // 4xkk
+    OP_SE_VX_VY,    // 5xy0
+    OP_LD_VX_KK,    // 6xkk
+    OP_ADD_VX_KK,   // 7xkk
+    OP_LD_VX_VY,    // 8xy0
+    OP_OR,          // 8xy1
+    OP_AND,         // 8xy2
+    OP_XOR,         // 8xy3
+    OP_ADD_VX_VY,   // 8xy4
+    OP_SUB,         // 8xy5
+    OP_SHR,         // 8xy6
+    OP_SUBN,        // 8xy7
+    OP_SHL,         // 8xyE
+    OP_SNE_VX_VY,   // 9xy0
+    OP_LD_I,        // Annn
+    OP_JP_V0,       // Bnnn
+    OP_RND,         // Cxkk
+    OP_DRW,         // Dxyn
+    OP_SKP,         // Ex9E
+    OP_SKNP,        // ExA1
+    OP_LD_VX_DT,    // Fx07
+    OP_LD_VX_K,     // Fx0A
+    OP_LD_DT_VX,    // Fx15
+    OP_LD_ST_VX,    // Fx18
+    OP_ADD_I_VX,    // Fx1E
+    OP_LD_F_VX,     // Fx29
+    OP_LD_B_VX,     // Fx33
+    OP_LD_I_VX,     // Fx55
+    OP_LD_VX_I,     // Fx65
+    OP_UNKNOWN,
+    OP_COUNT
+} op_t;
+
 
 void run_instruction(chip8_t* chip);
 
-#endif
\ No newline at end of file
+// runs up to count instructions, returns how many ran: fewer when an idle loop or display wait ends the call early
+uint32_t run_instructions(chip8_t* chip, uint32_t count);
+
+// one 60 Hz frame: ipf instructions, then one timer tick; returns the instructions that ran like run_instructions()
+uint32_t run_frame(chip8_t* chip, uint32_t ipf);
+
+// count instructions with no timer ticks, returns how many ran: calls run_instructions() again after every
+// QUIRK_DISPLAY_WAIT draw until the count is spent, an idle loop or key wait spends the rest of a call as it would a frame
+uint64_t run_budget(chip8_t* chip, uint64_t count);
+
+// count delay_timer and sound_timer down by one, called once per 60 Hz frame
+void tick_timers(chip8_t* chip);
+
+uint8_t decode_opcode(uint16_t opcode);
+
+// true when the instruction at pc is one run_instructions() idles on: a jump to itself, or Fx0A with no key down
+bool idles_at(const chip8_t* chip, uint16_t pc);
+
+// Cowgod's mnemonic for opcode, e.g. "DRW V0, V1, 5", DW and the word for one that isn't an instruction
+void disassemble(uint16_t opcode, char* text, size_t size);
+
+// next Cxkk byte from chip->rng
+uint8_t random_byte(chip8_t* chip);
+
+// drop cached decodes overlapping memory[addr, addr + len), call after writing chip->memory from outside the interpreter
+void invalidate_decoded(chip8_t* chip, uint16_t addr, uint16_t len);
+
+#endif
@@ -1,369 +1,326 @@
 #include "instructions.h"
 #include "chip8.h"
+#include "profile.h"
+#include "trace.h"
 
 #include <stdint.h>
+#include <stdio.h>
+#include <string.h>
 
 
-void next(chip8_t* chip)
-{
-    chip->instruction->opcode  = chip->memory[chip->pc];
-    chip->instruction->opcode <<= 8;
-    chip->instruction->opcode  |= chip->memory[chip->pc + 1];
-    chip->pc += 2;
-    chip->instruction->nnn  = chip->instruction->opcode  & 0x0FFF;
-    chip->instruction->kk   = chip->instruction->opcode  & 0x00FF;
-    chip->instruction->n    = chip->instruction->opcode  & 0x000F;
-    chip->instruction->x    = (chip->instruction->opcode >> 8)  & 0x0F;
-    chip->instruction->y    = (chip->instruction->opcode >> 4) & 0x0F;
-
-    // #ifdef DEBUG
-    //     printf("Opcode: %.4X\n", chip->instruction->opcode);
-    //     printf("nnn: %.4X\n", chip->instruction->nnn);
-    //     printf("kk: %.4X\n", chip->instruction->kk);
-    //     printf("n: %.4X\n", chip->instruction->n);
-    //     printf("x: %.4X\n", chip->instruction->x);
-    //     printf("y: %.4X\n", chip->instruction->y);
-    //     printf("I: %.4X\n", chip->i);
-    //     printf("pc: %.4X\n\n", chip->pc);
-    // #endif
-}
+// memory accesses wrap at 4K like the address bus of the original machine
+#define MEM(addr) chip->memory[(addr) & 0xFFF]
 
 
-void run_instruction(chip8_t* chip)
+uint8_t decode_opcode(uint16_t opcode)
 {
-    next(chip);
-    
-    switch((chip->instruction->opcode & 0xF000) >> 12)
+    const uint8_t n  = opcode & 0x000F;
+    const uint8_t kk = opcode & 0x00FF;
+
+    switch (opcode >> 12)
     {
         case 0x0:
-        {
-            /*
-                00E0 - CLS
-                Clear the display.
-            */
-            if(chip->instruction->opcode == 0x00E0)
+            if (opcode == 0x00E0) return OP_CLS;
+            if (opcode == 0x00EE) return OP_RET;
+            return OP_SYS;
+        case 0x1: return OP_JP;
+        case 0x2: return OP_CALL;
+        case 0x3: return OP_SE_VX_KK;
+        case 0x4: return OP_SNE_VX_KK;
+        case 0x5: return n == 0 ? OP_SE_VX_VY : OP_UNKNOWN;
+        case 0x6: return OP_LD_VX_KK;
+        case 0x7: return OP_ADD_VX_KK;
+        case 0x8:
+            switch (n)
             {
-                #ifdef DEBUG
-                    printf("00E0 - CLS: Clear the display.\n");
-                    printf("Opcode: %.4X\n", chip->instruction->opcode);
-                #endif
-                memset(&chip->display[0], false, sizeof(chip->display));
-                chip->redraw = true;
+                case 0x0: return OP_LD_VX_VY;
+                case 0x1: return OP_OR;
+                case 0x2: return OP_AND;
+                case 0x3: return OP_XOR;
+                case 0x4: return OP_ADD_VX_VY;
+                case 0x5: return OP_SUB;
+                case 0x6: return OP_SHR;
+                case 0x7: return OP_SUBN;
+                case 0xE: return OP_SHL;
             }
-            /*
-                00EE - RET
-                Return from a subroutine.
-                The interpreter sets the program counter to the address at the top of the stack, 
-                    then subtracts 1 from the stack pointer.
-
-            */
-            else if (chip->instruction->opcode == 0x00EE)
+            return OP_UNKNOWN;
+        case 0x9: return n == 0 ? OP_SNE_VX_VY : OP_UNKNOWN;
+        case 0xA: return OP_LD_I;
+        case 0xB: return OP_JP_V0;
+        case 0xC: return OP_RND;
+        case 0xD: return OP_DRW;
+        case 0xE:
+            if (kk == 0x9E) return OP_SKP;
+            if (kk == 0xA1) return OP_SKNP;
+            return OP_UNKNOWN;
+        case 0xF:
+            switch (kk)
             {
-                chip->pc = *chip->stack_ptr;
-                chip->stack_ptr--;
-                #ifdef DEBUG
-                    printf("00EE - RET: Return from a subroutine.\n");
-                    printf("Opcode: %.4X\n", chip->instruction->opcode);
-                    printf("pc: %.4X\n", chip->pc);
-                    printf("nnn: %.4X\n", *chip->stack_ptr);
-                #endif
-                break;
+                case 0x07: return OP_LD_VX_DT;
+                case 0x0A: return OP_LD_VX_K;
+                case 0x15: return OP_LD_DT_VX;
+                case 0x18: return OP_LD_ST_VX;
+                case 0x1E: return OP_ADD_I_VX;
+                case 0x29: return OP_LD_F_VX;
+                case 0x33: return OP_LD_B_VX;
+                case 0x55: return OP_LD_I_VX;
+                case 0x65: return OP_LD_VX_I;
             }
-            /*
-                0nnn - SYS addr
-                Jump to a machine code routine at nnn.
-                This instruction is only used on the old computers on which Chip-8 was originally implemented.
-                     is ignored by modern interpreters.
-            */
-            else
-            {
-                
-                // chip->pc = chip->instruction->nnn;
-            }
-            break;
-        }
-
-
-        // 1nnn - JP addr
-        // Jump to location nnn.
-        
-        // The interpreter sets the program counter to nnn.
-        case 0x1:
-        {
-            chip->pc = chip->instruction->nnn;
-            #ifdef DEBUG
-                printf("1nnn - JP addr: Jump to location nnn(%X).", chip->instruction->nnn);
-                printf("Opcode: %.4X\n", chip->instruction->opcode);
-                printf("pc: %.4X\n", chip->pc);
-                printf("nnn: %.4X\n", chip->instruction->nnn);
-            #endif
-            break;
-        }
-            
-
-
-        // 2nnn - CALL addr
-        // Call subroutine at nnn.
-
-        // The interpreter increments the stack pointer, then puts the current PC on the top of the stack. The PC is then set to nnn.
-
-
-        // 3xkk - SE Vx, byte
-        // Skip next instruction if Vx = kk.
-
-        // The interpreter compares register Vx to kk, and if they are equal, increments the program counter by 2.
-
-
-        // 4xkk - SNE Vx, byte
-        // Skip next instruction if Vx != kk.
-
-        // The interpreter compares register Vx to kk, and if they are not equal, increments the program counter by 2.
-
-
-        // 5xy0 - SE Vx, Vy
-        // Skip next instruction if Vx = Vy.
-
-        // The interpreter compares register Vx to register Vy, and if they are equal, increments the program counter by 2.
-
-
-        // 6xkk - LD Vx, byte
-        // Set Vx = kk.
-
-        // The interpreter puts the value kk into register Vx.
-        case 0x6:
-        {
-            chip->v[chip->instruction->x] = chip->instruction->kk;
-            #ifdef DEBUG
-                printf("6xkk - LD Vx, byte: Set Vx(%X) = kk(%X).\n", chip->v[chip->instruction->x], chip->instruction->kk);
-                printf("Opcode: %.4X\n", chip->instruction->opcode);
-                printf("V[x]: %.4X\n", chip->v[chip->instruction->x]);
-                printf("x: %.4X\n", chip->instruction->x);
-                printf("kk: %.4X\n", chip->instruction->kk);
-            #endif
-            break;
-        }
-            
-
-        // 7xkk - ADD Vx, byte
-        // Set Vx = Vx + kk.
-
-        // Adds the value kk to the value of register Vx, then stores the result in Vx. 
-        case 0x7:
-        {
-            #ifdef DEBUG
-                printf("7xkk - ADD Vx, byte\n");
-                printf("Opcode: %.4X\n", chip->instruction->opcode);
-                printf("V[x]: %.4X\n", chip->v[chip->instruction->x]);
-            #endif
-            chip->v[chip->instruction->x] = chip->v[chip->instruction->x] + chip->instruction->kk;
-            #ifdef DEBUG
-                printf("V[x] after addition: %.4X\n", chip->v[chip->instruction->x]);
-            #endif
-            break;
-        }
-
-        // 8xy0 - LD Vx, Vy
-        // Set Vx = Vy.
-
-        // Stores the value of register Vy in register Vx.
-
-
-        // 8xy1 - OR Vx, Vy
-        // Set Vx = Vx OR Vy.
-
-        // Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx. A bitwise OR compares the corrseponding bits from two values, and if either bit is 1, then the same bit in the result is also 1. Otherwise, it is 0. 
-
-
-        // 8xy2 - AND Vx, Vy
-        // Set Vx = Vx AND Vy.
-
-        // Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx. A bitwise AND compares the corrseponding bits from two values, and if both bits are 1, then the same bit in the result is also 1. Otherwise, it is 0. 
-
-
-        // 8xy3 - XOR Vx, Vy
-        // Set Vx = Vx XOR Vy.
-
-        // Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx. An exclusive OR compares the corrseponding bits from two values, and if the bits are not both the same, then the corresponding bit in the result is set to 1. Otherwise, it is 0. 
-
-
-        // 8xy4 - ADD Vx, Vy
-        // Set Vx = Vx + Vy, set VF = carry.
-
-        // The values of Vx and Vy are added together. If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0. Only the lowest 8 bits of the result are kept, and stored in Vx.
-
-
-        // 8xy5 - SUB Vx, Vy
-        // Set Vx = Vx - Vy, set VF = NOT borrow.
-
-        // If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx, and the results stored in Vx.
+            return OP_UNKNOWN;
+    }
+    return OP_UNKNOWN;
+}
 
 
-        // 8xy6 - SHR Vx {, Vy}
-        // Set Vx = Vx SHR 1.
+/*
+    Fetches the instruction at pc into chip->instruction and fills its slot
+    in the decode cache. Only runs on a cache miss.
+*/
+static void next(chip8_t* chip, uint16_t pc, decoded_t* d)
+{
+    chip->instruction.opcode  = MEM(pc);
+    chip->instruction.opcode <<= 8;
+    chip->instruction.opcode  |= MEM(pc + 1);
+    chip->instruction.nnn  = chip->instruction.opcode  & 0x0FFF;
+    chip->instruction.kk   = chip->instruction.opcode  & 0x00FF;
+    chip->instruction.n    = chip->instruction.opcode  & 0x000F;
+    chip->instruction.x    = (chip->instruction.opcode >> 8)  & 0x0F;
+    chip->instruction.y    = (chip->instruction.opcode >> 4) & 0x0F;
+
+    d->op = decode_opcode(chip->instruction.opcode);
+    d->x  = chip->instruction.x;
+    d->y  = chip->instruction.y;
+    d->kk = chip->instruction.kk;
+}
 
-        // If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
 
+void disassemble(uint16_t opcode, char* text, size_t size)
+{
+    const uint8_t x = (opcode >> 8) & 0x0F;
+    const uint8_t y = (opcode >> 4) & 0x0F;
+    const uint8_t kk = opcode & 0x00FF;
+    const uint16_t nnn = opcode & 0x0FFF;
 
-        // 8xy7 - SUBN Vx, Vy
-        // Set Vx = Vy - Vx, set VF = NOT borrow.
+    switch (decode_opcode(opcode))
+    {
+        case OP_CLS:        snprintf(text, size, "CLS"); break;
+        case OP_RET:        snprintf(text, size, "RET"); break;
+        case OP_SYS:        snprintf(text, size, "SYS %.3X", nnn); break;
+        case OP_JP:         snprintf(text, size, "JP %.3X", nnn); break;
+        case OP_CALL:       snprintf(text, size, "CALL %.3X", nnn); break;
+        case OP_SE_VX_KK:   snprintf(text, size, "SE V%X, %.2X", x, kk); break;
+        case OP_SNE_VX_KK:  snprintf(text, size, "SNE V%X, %.2X", x, kk); break;
+        case OP_SE_VX_VY:   snprintf(text, size, "SE V%X, V%X", x, y); break;
+        case OP_LD_VX_KK:   snprintf(text, size, "LD V%X, %.2X", x, kk); break;
+        case OP_ADD_VX_KK:  snprintf(text, size, "ADD V%X, %.2X", x, kk); break;
+        case OP_LD_VX_VY:   snprintf(text, size, "LD V%X, V%X", x, y); break;
+        case OP_OR:         snprintf(text, size, "OR V%X, V%X", x, y); break;
+        case OP_AND:        snprintf(text, size, "AND V%X, V%X", x, y); break;
+        case OP_XOR:        snprintf(text, size, "XOR V%X, V%X", x, y); break;
+        case OP_ADD_VX_VY:  snprintf(text, size, "ADD V%X, V%X", x, y); break;
+        case OP_SUB:        snprintf(text, size, "SUB V%X, V%X", x, y); break;
+        case OP_SHR:        snprintf(text, size, "SHR V%X, V%X", x, y); break;
+        case OP_SUBN:       snprintf(text, size, "SUBN V%X, V%X", x, y); break;
+        case OP_SHL:        snprintf(text, size, "SHL V%X, V%X", x, y); break;
+        case OP_SNE_VX_VY:  snprintf(text, size, "SNE V%X, V%X", x, y); break;
+        case OP_LD_I:       snprintf(text, size, "LD I, %.3X", nnn); break;
+        case OP_JP_V0:      snprintf(text, size, "JP V0, %.3X", nnn); break;
+        case OP_RND:        snprintf(text, size, "RND V%X, %.2X", x, kk); break;
+        case OP_DRW:        snprintf(text, size, "DRW V%X, V%X, %X", x, y, opcode & 0x0F); break;
+        case OP_SKP:        snprintf(text, size, "SKP V%X", x); break;
+        case OP_SKNP:       snprintf(text, size, "SKNP V%X", x); break;
+        case OP_LD_VX_DT:   snprintf(text, size, "LD V%X, DT", x); break;
+        case OP_LD_VX_K:    snprintf(text, size, "LD V%X, K", x); break;
+        case OP_LD_DT_VX:   snprintf(text, size, "LD DT, V%X", x); break;
+        case OP_LD_ST_VX:   snprintf(text, size, "LD ST, V%X", x); break;
+        case OP_ADD_I_VX:   snprintf(text, size, "ADD I, V%X", x); break;
+        case OP_LD_F_VX:    snprintf(text, size, "LD F, V%X", x); break;
+        case OP_LD_B_VX:    snprintf(text, size, "LD B, V%X", x); break;
+        case OP_LD_I_VX:    snprintf(text, size, "LD [I], V%X", x); break;
+        case OP_LD_VX_I:    snprintf(text, size, "LD V%X, [I]", x); break;
+        default:            snprintf(text, size, "DW %.4X", opcode); break;
+    }
+}
 
-        // If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
 
+void invalidate_decoded(chip8_t* chip, uint16_t addr, uint16_t len)
+{
+    // the slot at addr - 1 holds an instruction whose low byte is at addr
+    for (uint16_t a = addr - 1; a != (uint16_t)(addr + len); a++)
+    {
+        chip->decoded[a & 0xFFF].op = OP_NONE;
+        chip->written_pages |= 1ULL << ((a & 0xFFF) >> 6);
+    }
+}
 
-        // 8xyE - SHL Vx {, Vy}
-        // Set Vx = Vx SHL 1.
 
-        // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2.
+uint8_t random_byte(chip8_t* chip)
+{
+    // xorshift32, kept in the machine so runs are reproducible
+    uint32_t r = chip->rng;
+    r ^= r << 13;
+    r ^= r >> 17;
+    r ^= r << 5;
+    chip->rng = r;
+    return r >> 24;
+}
 
 
-        // 9xy0 - SNE Vx, Vy
-        // Skip next instruction if Vx != Vy.
+// Fx07 at addr then 3xkk or 4xkk on the same register that won't skip, with Vx already holding the timer
+static bool timer_poll(const chip8_t* chip, uint16_t addr)
+{
+    const decoded_t* load = &chip->decoded[addr & 0xFFF];
+    const decoded_t* skip = &chip->decoded[(addr + 2) & 0xFFF];
+    if (load->op != OP_LD_VX_DT || (skip->op != OP_SE_VX_KK && skip->op != OP_SNE_VX_KK) || skip->x != load->x) {
+        return false;
+    }
+    const uint8_t value = chip->delay_timer;
+    return chip->v[load->x] == value && (skip->op == OP_SE_VX_KK ? value != skip->kk : value == skip->kk);
+}
 
-        // The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
 
+// charges ticks to the instruction that just finished
+static void charge(profile_t* profile, uint8_t op, uint64_t ticks)
+{
+    profile->op_ticks[op] += ticks;
+    if (op == OP_DRW) {
+        const uint8_t bucket = ticks ? 63 - __builtin_clzll(ticks) : 0;
+        profile->draw_ticks[bucket < DRAW_BUCKETS ? bucket : DRAW_BUCKETS - 1]++;
+    }
+}
 
-        // Annn - LD I, addr
-        // Set I = nnn.
 
-        // The value of register I is set to nnn.
-        case 0xA: // TODO: nnn is only kk?
-        {
-            /*
-            Annn - LD I, addr: Set I = nnn(66).
-                Opcode: A266
-                i: 0066
-                nnn: 0066
-            */
-            chip->i = chip->instruction->nnn;
-            #ifdef DEBUG
-                printf("Annn - LD I, addr: Set I = nnn(%X).\n", chip->instruction->nnn);
-                printf("Opcode: %.4X\n", chip->instruction->opcode);
-                printf("i: %.4X\n", chip->i);
-                printf("nnn: %.4X\n", chip->instruction->nnn);
-            #endif
-        }
+void run_instruction(chip8_t* chip)
+{
+    run_instructions(chip, 1);
+}
 
-        // Bnnn - JP V0, addr
-        // Jump to location nnn + V0.
 
-        // The program counter is set to nnn plus the value of V0.
+void tick_timers(chip8_t* chip)
+{
+    if (chip->delay_timer > 0) chip->delay_timer--;
+    if (chip->sound_timer > 0) chip->sound_timer--;
+}
 
 
-        // Cxkk - RND Vx, byte
-        // Set Vx = random byte AND kk.
+uint32_t run_frame(chip8_t* chip, uint32_t ipf)
+{
+    const uint32_t ran = run_instructions(chip, ipf);
+    tick_timers(chip);
+    return ran;
+}
 
-        // The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk. The results are stored in Vx. See instruction 8xy2 for more information on AND.
+bool idles_at(const chip8_t* chip, uint16_t pc)
+{
+    pc &= 0xFFF;
+    if (pc + 1 >= sizeof(chip->memory)) {
+        return false;
+    }
+    const uint16_t opcode = chip->memory[pc] << 8 | chip->memory[pc + 1];
+    if (opcode == (0x1000 | pc)) {
+        return true;
+    }
+    if ((opcode & 0xF0FF) != 0xF00A) {
+        return false;
+    }
+    for (uint8_t key = 0; key < 16; key++)
+    {
+        if (chip->keypad[key]) return false;
+    }
+    return true;
+}
 
+uint64_t run_budget(chip8_t* chip, uint64_t count)
+{
+    uint64_t executed = 0;
+    while (count > 0)
+    {
+        const uint32_t step = count > UINT32_MAX ? UINT32_MAX : count;
+        const uint32_t ran = run_instructions(chip, step);
+        executed += ran;
+        // a display wait only ends the frame, without frames nothing waits for it
+        count -= chip->idle == IDLE_NONE ? ran : step;
+    }
+    return executed;
+}
 
-        // Dxyn - DRW Vx, Vy, nibble
-        // Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
 
-        // The interpreter reads n bytes from memory, starting at the address stored in I. These bytes are then displayed as sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen. If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0. If the sprite is positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side of the screen. See instruction 8xy3 for more information on XOR, and section 2.4, Display, for more information on the Chip-8 screen and sprites.
-        case 0xD:
+#define RUN run_modern
+#define QUIRKS MODERN_QUIRKS
+#define TRACED 0
+#include "dispatch.h"
+
+#define RUN run_vip
+#define QUIRKS VIP_QUIRKS
+#define TRACED 0
+#include "dispatch.h"
+
+#define RUN run_schip
+#define QUIRKS SCHIP_QUIRKS
+#define TRACED 0
+#include "dispatch.h"
+
+#define RUN run_xochip
+#define QUIRKS XOCHIP_QUIRKS
+#define TRACED 0
+#include "dispatch.h"
+
+#define RUN trace_modern
+#define QUIRKS MODERN_QUIRKS
+#define TRACED 1
+#include "dispatch.h"
+
+#define RUN trace_vip
+#define QUIRKS VIP_QUIRKS
+#define TRACED 1
+#include "dispatch.h"
+
+#define RUN trace_schip
+#define QUIRKS SCHIP_QUIRKS
+#define TRACED 1
+#include "dispatch.h"
+
+#define RUN trace_xochip
+#define QUIRKS XOCHIP_QUIRKS
+#define TRACED 1
+#include "dispatch.h"
+
+
+/*
+    Runs count instructions. Each pc has a slot in chip->decoded holding the
+    dispatch index and pre-extracted operands, so after the first visit an
+    instruction costs one load and an indirect jump to its handler.
+    With a profile active every index goes to op_profile first. With a
+    trace active instead, a copy that records each instruction runs.
+
+    Idle loops (a jump to itself, a delay timer poll, Fx0A with no key) end
+    the call early: repeating them changes nothing until the timers tick or
+    a key goes down, so the remaining count is dropped, in whole loop
+    iterations, and chip->idle says why. Not while profiling, so counts stay
+    true. A draw under QUIRK_DISPLAY_WAIT drops the rest too. The return
+    value counts only the instructions that really ran, so throughput
+    figures don't credit the ones dropped.
+
+    The loop itself is in dispatch.h, compiled once per quirk profile with
+    the profile's flags as constants, and once more per profile with
+    tracing; chip->quirks and active_trace pick the copy once per call.
+*/
+uint32_t run_instructions(chip8_t* chip, uint32_t count)
+{
+    if (active_trace && !active_profile) {
+        switch (chip->quirks)
         {
-            #ifdef DEBUG
-                printf("Dxyn - DRW Vx(%X), Vy(%X), nibble(%X)\n", chip->v[chip->instruction->x], chip->v[chip->instruction->y], chip->instruction->n);
-            #endif
-            uint8_t x = chip->v[chip->instruction->x] % WIDTH;
-            uint8_t y = chip->v[chip->instruction->y] % HEIGHT;
-
-            const uint8_t og_x = x;
-
-            chip->v[0x0F] = 0;
-            // loop over sprite rows (N in total)
-            for (uint8_t i = 0; i < chip->instruction->n; i++) {
-                const uint8_t sprite_data = chip->memory[chip->i + i]; // next byte/row of sprite data
-
-                x = og_x; // reset x for the next row to draw
-
-                for (int8_t j = 7; j >= 0; j--) {
-                    const bool sprite_bit = (sprite_data & (1 << j));
-                    bool *pixel           = &chip->display[y * WIDTH + x];
-
-                    // if sprite pixel is on and display pixel is on, set carry flag
-                    if (sprite_bit && *pixel) chip->v[0x0F] = 1;
-
-                    // xor display pixel with sprite pixel to set it on/off
-                    *pixel ^= sprite_bit;
-
-                    // stop drawing if we hit right screen edge
-                    if (++x >= WIDTH) break;
-                }
-
-                // stop drawing the entire sprite if we hit bottom screen edge
-                if (++y >= HEIGHT) break;
-            }
-            chip->redraw = true; // will update the screen on next tick
-            break;
+            case QUIRKS_VIP:    return trace_vip(chip, count);
+            case QUIRKS_SCHIP:  return trace_schip(chip, count);
+            case QUIRKS_XOCHIP: return trace_xochip(chip, count);
+            default:            return trace_modern(chip, count);
         }
-            
-
-        // Ex9E - SKP Vx
-        // Skip next instruction if key with the value of Vx is pressed.
-
-        // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
-
-
-        // ExA1 - SKNP Vx
-        // Skip next instruction if key with the value of Vx is not pressed.
-
-        // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
-
-
-        // Fx07 - LD Vx, DT
-        // Set Vx = delay timer value.
-
-        // The value of DT is placed into Vx.
-
-
-        // Fx0A - LD Vx, K
-        // Wait for a key press, store the value of the key in Vx.
-
-        // All execution stops until a key is pressed, then the value of that key is stored in Vx.
-
-
-        // Fx15 - LD DT, Vx
-        // Set delay timer = Vx.
-
-        // DT is set equal to the value of Vx.
-
-
-        // Fx18 - LD ST, Vx
-        // Set sound timer = Vx.
-
-        // ST is set equal to the value of Vx.
-
-
-        // Fx1E - ADD I, Vx
-        // Set I = I + Vx.
-
-        // The values of I and Vx are added, and the results are stored in I.
-
-
-        // Fx29 - LD F, Vx
-        // Set I = location of sprite for digit Vx.
-
-        // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx. See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
-
-
-        // Fx33 - LD B, Vx
-        // Store BCD representation of Vx in memory locations I, I+1, and I+2.
-
-        // The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.
-
-
-        // Fx55 - LD [I], Vx
-        // Store registers V0 through Vx in memory starting at location I.
-
-        // The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
-
-
-        // Fx65 - LD Vx, [I]
-        // Read registers V0 through Vx from memory starting at location I.
-
-        // The interpreter reads values from memory starting at location I into registers V0 through Vx.
-
-        default:
-            printf("OPCODE %X not implemented\n", chip->instruction->opcode);
     }
-}
\ No newline at end of file
+    switch (chip->quirks)
+    {
+        case QUIRKS_VIP:    return run_vip(chip, count);
+        case QUIRKS_SCHIP:  return run_schip(chip, count);
+        case QUIRKS_XOCHIP: return run_xochip(chip, count);
+        default:            return run_modern(chip, count);
+    }
+}
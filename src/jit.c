@@ -0,0 +1,486 @@
+#include "jit.h"
+#include "chip8.h"
+#include "instructions.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <sys/mman.h>
+#endif
+
+
+#define CODE_SIZE   (1 << 20)   // executable buffer, reset when full
+#define MAX_BLOCK   32          // instructions per translated block
+#define MAX_EMIT    64          // upper bound of bytes emitted per instruction
+
+typedef void (*block_fn)(chip8_t* chip);
+
+typedef struct
+{
+    block_fn fn;        // NULL when the first instruction has to be interpreted
+    uint16_t end;       // one past the last source byte
+    uint8_t count;      // instructions executed by one call
+    bool translated;
+} block_t;
+
+struct jit
+{
+    chip8_t* chip;
+    uint8_t* code;
+    size_t used;
+    bool writable;          // code is mapped read-write for translate(), read-execute for running it, never both
+    block_t blocks[4096];   // indexed by start pc
+};
+
+
+#if defined(__x86_64__)
+
+// chip8_t field offsets used as [rdi + disp32] operands
+#define OFF_V(r)    ((int32_t)(offsetof(chip8_t, v) + (r)))
+#define OFF_I       ((int32_t)offsetof(chip8_t, i))
+#define OFF_PC      ((int32_t)offsetof(chip8_t, pc))
+#define OFF_DT      ((int32_t)offsetof(chip8_t, delay_timer))
+#define OFF_ST      ((int32_t)offsetof(chip8_t, sound_timer))
+#define OFF_KEYPAD  ((int32_t)offsetof(chip8_t, keypad))
+#define OFF_KEYS_READ ((int32_t)offsetof(chip8_t, keys_read))
+#define OFF_STACK   ((int32_t)offsetof(chip8_t, stack))
+#define OFF_SP      ((int32_t)offsetof(chip8_t, sp))
+
+// modrm byte for [rdi + disp32] with the given register field
+#define RDI_DISP32(reg) (0x80 | ((reg) << 3) | 7)
+
+enum { EAX = 0, ECX = 1, EDX = 2 };
+
+
+static void emit8(uint8_t** p, uint8_t b)
+{
+    *(*p)++ = b;
+}
+
+static void emit16(uint8_t** p, uint16_t w)
+{
+    memcpy(*p, &w, 2);
+    *p += 2;
+}
+
+static void emit32(uint8_t** p, int32_t d)
+{
+    memcpy(*p, &d, 4);
+    *p += 4;
+}
+
+// op r/m, [rdi + disp], optional 0x0F prefix in the high byte of opcode
+static void emit_rdi(uint8_t** p, uint16_t opcode, uint8_t reg, int32_t disp)
+{
+    if (opcode > 0xFF) emit8(p, opcode >> 8);
+    emit8(p, opcode & 0xFF);
+    emit8(p, RDI_DISP32(reg));
+    emit32(p, disp);
+}
+
+// movzx reg, byte [rdi + disp]
+static void load8(uint8_t** p, uint8_t reg, int32_t disp)
+{
+    emit_rdi(p, 0x0FB6, reg, disp);
+}
+
+// mov byte [rdi + disp], reg
+static void store8(uint8_t** p, uint8_t reg, int32_t disp)
+{
+    emit_rdi(p, 0x88, reg, disp);
+}
+
+// mov word [rdi + disp], imm16
+static void store16_imm(uint8_t** p, int32_t disp, uint16_t imm)
+{
+    emit8(p, 0x66);
+    emit_rdi(p, 0xC7, 0, disp);
+    emit16(p, imm);
+}
+
+// setc / setnc dl, then VF = dl
+static void store_flag(uint8_t** p, bool carry)
+{
+    emit8(p, 0x0F);
+    emit8(p, carry ? 0x92 : 0x93);
+    emit8(p, 0xC2);
+    store8(p, EDX, OFF_V(0xF));
+}
+
+/*
+    Conditional skip: pc = next, and pc = next + 2 when the flags left by the
+    compare emitted before satisfy the skip. jcc_over is the jcc opcode that
+    jumps over the skip.
+*/
+static void emit_skip(uint8_t** p, uint16_t next, uint8_t jcc_over)
+{
+    emit8(p, jcc_over);
+    emit8(p, 9);                        // length of the store below
+    store16_imm(p, OFF_PC, next + 2);
+    emit8(p, 0xC3);                     // ret
+}
+
+
+/*
+    Emits one instruction at the write cursor. Returns false if the
+    instruction can't be translated, in which case nothing was emitted.
+    *ends is set for instructions that leave the block.
+*/
+static bool emit_instruction(uint8_t** p, uint16_t addr, uint16_t opcode, bool* ends)
+{
+    const uint8_t x   = (opcode >> 8) & 0x0F;
+    const uint8_t y   = (opcode >> 4) & 0x0F;
+    const uint8_t kk  = opcode & 0xFF;
+    const uint16_t nnn = opcode & 0x0FFF;
+    const uint16_t next = addr + 2;
+
+    *ends = false;
+
+    switch (decode_opcode(opcode))
+    {
+        case OP_SYS:
+            return true;
+
+        case OP_LD_VX_KK:
+            emit_rdi(p, 0xC6, 0, OFF_V(x));     // mov byte [vx], kk
+            emit8(p, kk);
+            return true;
+
+        case OP_ADD_VX_KK:
+            emit_rdi(p, 0x80, 0, OFF_V(x));     // add byte [vx], kk
+            emit8(p, kk);
+            return true;
+
+        case OP_LD_VX_VY:
+            load8(p, EAX, OFF_V(y));
+            store8(p, EAX, OFF_V(x));
+            return true;
+
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+        {
+            const uint8_t op = decode_opcode(opcode);
+            const uint8_t alu = op == OP_OR ? 0x08 : op == OP_AND ? 0x20 : 0x30;
+            load8(p, EAX, OFF_V(y));
+            emit_rdi(p, alu, EAX, OFF_V(x));    // or/and/xor byte [vx], al
+            return true;
+        }
+
+        case OP_ADD_VX_VY:
+        case OP_SUB:
+        case OP_SUBN:
+        {
+            const uint8_t op = decode_opcode(opcode);
+            const uint8_t a = op == OP_SUBN ? y : x;
+            const uint8_t b = op == OP_SUBN ? x : y;
+            load8(p, EAX, OFF_V(a));
+            load8(p, ECX, OFF_V(b));
+            emit8(p, op == OP_ADD_VX_VY ? 0x00 : 0x28);   // add/sub al, cl
+            emit8(p, 0xC8);
+            store8(p, EAX, OFF_V(x));
+            // carry for add, not borrow for sub
+            store_flag(p, op == OP_ADD_VX_VY);
+            return true;
+        }
+
+        case OP_SHR:
+        case OP_SHL:
+            load8(p, EAX, OFF_V(x));
+            emit8(p, 0xD0);                     // shr/shl al, 1
+            emit8(p, decode_opcode(opcode) == OP_SHR ? 0xE8 : 0xE0);
+            store8(p, EAX, OFF_V(x));
+            store_flag(p, true);                // shifted out bit
+            return true;
+
+        case OP_LD_I:
+            store16_imm(p, OFF_I, nnn);
+            return true;
+
+        case OP_LD_VX_DT:
+            load8(p, EAX, OFF_DT);
+            store8(p, EAX, OFF_V(x));
+            return true;
+
+        case OP_LD_DT_VX:
+        case OP_LD_ST_VX:
+            load8(p, EAX, OFF_V(x));
+            store8(p, EAX, decode_opcode(opcode) == OP_LD_DT_VX ? OFF_DT : OFF_ST);
+            return true;
+
+        case OP_ADD_I_VX:
+            load8(p, EAX, OFF_V(x));
+            emit8(p, 0x66);                     // add word [i], ax
+            emit_rdi(p, 0x01, EAX, OFF_I);
+            return true;
+
+        case OP_LD_F_VX:
+            load8(p, EAX, OFF_V(x));
+            emit8(p, 0x83); emit8(p, 0xE0); emit8(p, 0x0F);     // and eax, 0xF
+            emit8(p, 0x8D); emit8(p, 0x04); emit8(p, 0x80);     // lea eax, [rax + rax * 4]
+            emit8(p, 0x66);                                     // mov word [i], ax
+            emit_rdi(p, 0x89, EAX, OFF_I);
+            return true;
+
+        case OP_JP:
+            store16_imm(p, OFF_PC, nnn);
+            emit8(p, 0xC3);
+            *ends = true;
+            return true;
+
+        case OP_CALL:
+            // movzx eax, byte [sp]; cmp eax, 11; jae full; inc eax; mov [sp], al
+            load8(p, EAX, OFF_SP);
+            emit8(p, 0x83); emit8(p, 0xF8); emit8(p, 11);
+            emit8(p, 0x73); emit8(p, 8);
+            emit8(p, 0xFF); emit8(p, 0xC0);
+            store8(p, EAX, OFF_SP);
+            // full: mov word [stack + rax * 2], next
+            emit8(p, 0x66); emit8(p, 0xC7); emit8(p, 0x84); emit8(p, 0x47); emit32(p, OFF_STACK); emit16(p, next);
+            store16_imm(p, OFF_PC, nnn);
+            emit8(p, 0xC3);
+            *ends = true;
+            return true;
+
+        case OP_RET:
+            // movzx eax, byte [sp]; movzx ecx, word [stack + rax * 2]; mov [pc], cx
+            load8(p, EAX, OFF_SP);
+            emit8(p, 0x0F); emit8(p, 0xB7); emit8(p, 0x8C); emit8(p, 0x47); emit32(p, OFF_STACK);
+            emit8(p, 0x66); emit_rdi(p, 0x89, ECX, OFF_PC);
+            // test eax, eax; jz empty; dec eax; mov [sp], al
+            emit8(p, 0x85); emit8(p, 0xC0);
+            emit8(p, 0x74); emit8(p, 8);
+            emit8(p, 0xFF); emit8(p, 0xC8);
+            store8(p, EAX, OFF_SP);
+            // empty:
+            emit8(p, 0xC3);
+            *ends = true;
+            return true;
+
+        case OP_SE_VX_KK:
+        case OP_SNE_VX_KK:
+            store16_imm(p, OFF_PC, next);
+            emit_rdi(p, 0x80, 7, OFF_V(x));     // cmp byte [vx], kk
+            emit8(p, kk);
+            emit_skip(p, next, decode_opcode(opcode) == OP_SE_VX_KK ? 0x75 : 0x74);
+            *ends = true;
+            return true;
+
+        case OP_SE_VX_VY:
+        case OP_SNE_VX_VY:
+            store16_imm(p, OFF_PC, next);
+            load8(p, EAX, OFF_V(x));
+            load8(p, ECX, OFF_V(y));
+            emit8(p, 0x38); emit8(p, 0xC8);     // cmp al, cl
+            emit_skip(p, next, decode_opcode(opcode) == OP_SE_VX_VY ? 0x75 : 0x74);
+            *ends = true;
+            return true;
+
+        case OP_SKP:
+        case OP_SKNP:
+            store16_imm(p, OFF_PC, next);
+            load8(p, EAX, OFF_V(x));
+            emit8(p, 0x83); emit8(p, 0xE0); emit8(p, 0x0F);     // and eax, 0xF
+            emit8(p, 0x66);
+            emit_rdi(p, 0x0FAB, EAX, OFF_KEYS_READ);            // bts word [keys_read], ax
+            // cmp byte [rdi + rax + keypad], 0
+            emit8(p, 0x80); emit8(p, 0xBC); emit8(p, 0x07); emit32(p, OFF_KEYPAD); emit8(p, 0x00);
+            emit_skip(p, next, decode_opcode(opcode) == OP_SKP ? 0x74 : 0x75);
+            *ends = true;
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+
+// flips the code buffer between writable and executable, false when the host refuses
+static bool protect_code(jit_t* jit, bool writable)
+{
+    if (jit->writable == writable) {
+        return true;
+    }
+    if (mprotect(jit->code, CODE_SIZE, writable ? PROT_READ | PROT_WRITE : PROT_READ | PROT_EXEC) != 0) {
+        return false;
+    }
+    jit->writable = writable;
+    return true;
+}
+
+
+static void translate(jit_t* jit, uint16_t start)
+{
+    block_t* block = &jit->blocks[start];
+    const chip8_t* chip = jit->chip;
+
+    if (!protect_code(jit, true)) {
+        // left to the interpreter
+        block->translated = true;
+        block->end = start;
+        block->count = 0;
+        block->fn = NULL;
+        return;
+    }
+    if (jit->used + MAX_BLOCK * MAX_EMIT > CODE_SIZE) {
+        // out of space, drop every translation and start over
+        memset(jit->blocks, 0, sizeof(jit->blocks));
+        jit->used = 0;
+    }
+
+    uint8_t* const entry = jit->code + jit->used;
+    uint8_t* p = entry;
+    uint16_t addr = start;
+    uint8_t count = 0;
+    bool ends = false;
+
+    while (!ends && count < MAX_BLOCK && addr + 1 < sizeof(chip->memory))
+    {
+        const uint16_t opcode = chip->memory[addr] << 8 | chip->memory[addr + 1];
+        if (!emit_instruction(&p, addr, opcode, &ends)) break;
+        addr += 2;
+        count++;
+    }
+
+    block->translated = true;
+    block->end = addr;
+    block->count = count;
+
+    if (count == 0) {
+        block->fn = NULL;
+        return;
+    }
+
+    if (!ends) {
+        // fell off the end of the block, continue at addr
+        store16_imm(&p, OFF_PC, addr);
+        emit8(&p, 0xC3);
+    }
+
+    block->fn = (block_fn)entry;
+    jit->used += p - entry;
+}
+
+
+/*
+    Drops translations overlapping the pages the interpreter wrote to since
+    the last call. Blocks are at most MAX_BLOCK instructions, so only blocks
+    starting shortly before a page can reach into it.
+*/
+static void invalidate_written(jit_t* jit)
+{
+    uint64_t pages = jit->chip->written_pages;
+    jit->chip->written_pages = 0;
+
+    while (pages)
+    {
+        const int page = __builtin_ctzll(pages);
+        pages &= pages - 1;
+
+        const int lo = page * 64;
+        const int hi = lo + 64;
+        const int from = lo - MAX_BLOCK * 2 < 0 ? 0 : lo - MAX_BLOCK * 2;
+
+        for (int start = from; start < hi; start++)
+        {
+            block_t* block = &jit->blocks[start];
+            if (block->translated && block->end > lo) {
+                block->translated = false;
+                block->fn = NULL;
+            }
+        }
+    }
+}
+
+
+jit_t* init_jit(chip8_t* chip)
+{
+    if (chip->quirks != QUIRKS_MODERN) {
+        fprintf(stderr, "The jit only translates the modern quirk profile, using the interpreter\n");
+        return NULL;
+    }
+    jit_t* jit = calloc(1, sizeof(jit_t));
+    if (!jit) {
+        return NULL;
+    }
+
+    // writable until the first block runs, see protect_code()
+    jit->code = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->code == MAP_FAILED) {
+        fprintf(stderr, "Failed to map jit code buffer, using the interpreter\n");
+        free(jit);
+        return NULL;
+    }
+
+    jit->writable = true;
+    jit->chip = chip;
+    // anything written before now is already in memory when blocks get translated
+    chip->written_pages = 0;
+    return jit;
+}
+
+
+uint32_t run_jit(jit_t* jit, uint32_t count)
+{
+    chip8_t* chip = jit->chip;
+    chip->idle = IDLE_NONE;
+    uint32_t ran = 0;
+
+    while (count > 0)
+    {
+        if (chip->written_pages) {
+            invalidate_written(jit);
+        }
+
+        // an idle loop goes to the interpreter, which skips it and counts it once
+        if (idles_at(chip, chip->pc)) {
+            ran += run_instructions(chip, count);
+            break;
+        }
+
+        block_t* block = &jit->blocks[chip->pc & 0xFFF];
+        if (!block->translated) {
+            translate(jit, chip->pc & 0xFFF);
+        }
+
+        if (block->fn && block->count <= count && protect_code(jit, false)) {
+            block->fn(chip);
+            count -= block->count;
+            ran += block->count;
+        } else {
+            ran += run_instructions(chip, 1);
+            count--;
+        }
+    }
+    return ran;
+}
+
+
+void close_jit(jit_t* jit)
+{
+    munmap(jit->code, CODE_SIZE);
+    free(jit);
+}
+
+#else
+
+jit_t* init_jit(chip8_t* chip)
+{
+    return NULL;
+}
+
+uint32_t run_jit(jit_t* jit, uint32_t count)
+{
+    return 0;
+}
+
+void close_jit(jit_t* jit)
+{
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef JIT_H
+#define JIT_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+    Dynamic recompiler for x86-64. Straight-line runs of opcodes are
+    translated into native code on first execution, anything it can't
+    translate is handed to run_instructions().
+*/
+typedef struct jit jit_t;
+
+// returns NULL when the host can't run translated code or chip has a quirk profile other than QUIRKS_MODERN, callers then use run_instructions()
+jit_t* init_jit(chip8_t* chip);
+
+// runs count instructions like run_instructions(), returning how many ran past an idle loop
+uint32_t run_jit(jit_t* jit, uint32_t count);
+
+void close_jit(jit_t* jit);
+
+#endif
@@ -0,0 +1,192 @@
+#include "latency.h"
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+// one keypad change on its way to the screen
+typedef struct
+{
+    uint64_t input;
+    uint64_t read;
+    uint64_t redraw;
+    uint8_t stage;      // latency_stage_t it waits for, LATENCY_STAGES when idle
+} pending_t;
+
+typedef struct
+{
+    uint64_t* ns;
+    uint32_t count;
+    uint32_t capacity;
+    bool sorted;
+} samples_t;
+
+struct latency
+{
+    pending_t keys[16];
+    samples_t stages[LATENCY_STAGES];
+    uint32_t dropped;
+};
+
+
+static void add_sample(samples_t* samples, uint64_t ns)
+{
+    if (samples->count == samples->capacity) {
+        samples->capacity = samples->capacity ? samples->capacity * 2 : 256;
+        samples->ns = realloc(samples->ns, samples->capacity * sizeof(uint64_t));
+    }
+    samples->ns[samples->count++] = ns;
+    samples->sorted = false;
+}
+
+static int compare_ns(const void* a, const void* b)
+{
+    const uint64_t x = *(const uint64_t*)a;
+    const uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+
+latency_t* init_latency()
+{
+    latency_t* latency = calloc(1, sizeof(latency_t));
+    if (!latency) {
+        return NULL;
+    }
+    for (uint8_t k = 0; k < 16; k++)
+    {
+        latency->keys[k].stage = LATENCY_STAGES;
+    }
+    return latency;
+}
+
+uint64_t latency_now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+void latency_input(latency_t* latency, uint8_t key)
+{
+    pending_t* p = &latency->keys[key & 0x0F];
+    if (p->stage != LATENCY_STAGES) {
+        latency->dropped++;
+    }
+    p->input = latency_now();
+    p->stage = LATENCY_READ;
+}
+
+void stamp_key_reads(chip8_t* chip, uint64_t read_at[16])
+{
+    const uint64_t now = latency_now();
+    for (uint16_t read = chip->keys_read; read; read &= read - 1)
+    {
+        const uint8_t k = __builtin_ctz(read);
+        if (read_at[k] == 0) read_at[k] = now;
+    }
+    chip->keys_read = 0;
+}
+
+void latency_reads(latency_t* latency, const uint64_t read_at[16])
+{
+    for (uint8_t k = 0; k < 16; k++)
+    {
+        pending_t* p = &latency->keys[k];
+        // a read from before the change reached the other thread isn't one of this input
+        if (p->stage == LATENCY_READ && read_at[k] >= p->input) {
+            p->read = read_at[k];
+            p->stage = LATENCY_REDRAW;
+            add_sample(&latency->stages[LATENCY_READ], read_at[k] - p->input);
+        }
+    }
+}
+
+void latency_redraw(latency_t* latency)
+{
+    const uint64_t now = latency_now();
+    for (uint8_t k = 0; k < 16; k++)
+    {
+        pending_t* p = &latency->keys[k];
+        if (p->stage == LATENCY_REDRAW) {
+            p->redraw = now;
+            p->stage = LATENCY_PRESENT;
+            add_sample(&latency->stages[LATENCY_REDRAW], now - p->input);
+        }
+    }
+}
+
+void latency_present(latency_t* latency)
+{
+    const uint64_t now = latency_now();
+    for (uint8_t k = 0; k < 16; k++)
+    {
+        pending_t* p = &latency->keys[k];
+        if (p->stage == LATENCY_PRESENT) {
+            p->stage = LATENCY_STAGES;
+            add_sample(&latency->stages[LATENCY_PRESENT], now - p->input);
+        }
+    }
+}
+
+uint32_t latency_samples(const latency_t* latency, latency_stage_t stage)
+{
+    return latency->stages[stage].count;
+}
+
+uint32_t latency_dropped(const latency_t* latency)
+{
+    uint32_t dropped = latency->dropped;
+    // still waiting at the end of the session
+    for (uint8_t k = 0; k < 16; k++)
+    {
+        dropped += latency->keys[k].stage != LATENCY_STAGES;
+    }
+    return dropped;
+}
+
+uint64_t latency_percentile(latency_t* latency, latency_stage_t stage, double percent)
+{
+    samples_t* samples = &latency->stages[stage];
+    if (samples->count == 0) return 0;
+    if (!samples->sorted) {
+        qsort(samples->ns, samples->count, sizeof(uint64_t), compare_ns);
+        samples->sorted = true;
+    }
+    // nearest rank
+    uint32_t rank = (uint32_t)(percent / 100.0 * samples->count + 0.999999);
+    if (rank < 1) rank = 1;
+    if (rank > samples->count) rank = samples->count;
+    return samples->ns[rank - 1];
+}
+
+void print_latency(latency_t* latency, FILE* out)
+{
+    static const char* names[LATENCY_STAGES] = { "input to read", "input to redraw", "input to present" };
+    static const double percents[] = { 50, 90, 99, 100 };
+
+    fprintf(out, "latency (ms)        samples     p50     p90     p99     max\n");
+    for (uint8_t s = 0; s < LATENCY_STAGES; s++)
+    {
+        fprintf(out, "%-18s %8u", names[s], latency_samples(latency, s));
+        for (uint8_t n = 0; n < sizeof(percents) / sizeof(percents[0]); n++)
+        {
+            fprintf(out, " %7.2f", latency_percentile(latency, s, percents[n]) / 1e6);
+        }
+        fprintf(out, "\n");
+    }
+    fprintf(out, "dropped: %u (never read, or overtaken before reaching the screen)\n", latency_dropped(latency));
+}
+
+void close_latency(latency_t* latency)
+{
+    for (uint8_t s = 0; s < LATENCY_STAGES; s++)
+    {
+        free(latency->stages[s].ns);
+    }
+    free(latency);
+}
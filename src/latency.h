@@ -0,0 +1,58 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+/*
+    Input to photon latency. Every keypad change is stamped as it enters the
+    emulator, then again at the end of the first frame whose instructions
+    looked at that key (chip8_t.keys_read), when the frame after that is
+    handed to draw(), and once its present returns. A change the program
+    never reads, or that a newer change of the same key overtakes before
+    it reaches the screen, is counted as dropped.
+*/
+typedef enum
+{
+    LATENCY_READ,       // input to the first Ex9E, ExA1 or Fx0A of the key
+    LATENCY_REDRAW,     // input to the first redraw afterwards
+    LATENCY_PRESENT,    // input to the present of that redraw returning
+    LATENCY_STAGES
+} latency_stage_t;
+
+typedef struct latency latency_t;
+
+latency_t* init_latency();
+
+// monotonic nanoseconds the stamps are taken in
+uint64_t latency_now();
+
+// a keypad change entering the emulator
+void latency_input(latency_t* latency, uint8_t key);
+
+// emulator thread, after a frame ran: consumes chip->keys_read into read_at, keeping the first read of each key
+void stamp_key_reads(chip8_t* chip, uint64_t read_at[16]);
+
+// window thread, from the frame handed over: read_at[k] is when key k was first read since it last changed, 0 when not yet
+void latency_reads(latency_t* latency, const uint64_t read_at[16]);
+
+// around draw(): before it starts and once its present has returned
+void latency_redraw(latency_t* latency);
+void latency_present(latency_t* latency);
+
+// samples taken at stage, and how many inputs never got through
+uint32_t latency_samples(const latency_t* latency, latency_stage_t stage);
+uint32_t latency_dropped(const latency_t* latency);
+
+// nanoseconds below which the given percent of the stage's samples fall, 0 without samples
+uint64_t latency_percentile(latency_t* latency, latency_stage_t stage, double percent);
+
+// percentiles of every stage in milliseconds
+void print_latency(latency_t* latency, FILE* out);
+
+void close_latency(latency_t* latency);
+
+#endif
@@ -0,0 +1,454 @@
+#include "audio.h"
+#include "chip8.h"
+#include "debugger.h"
+#include "display.h"
+#include "frames.h"
+#include "instructions.h"
+#include "latency.h"
+#include "movie.h"
+#include "rewind.h"
+#include "trace.h"
+
+#include <SDL.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+
+static void usage(const char* exe)
+{
+    fprintf(stderr, "usage: %s [--ipf N] [--turbo] [--seed N] [--record FILE] [--latency] [--quirks modern|vip|schip|xochip] [--trace FILE] [--debug] [rom]\n", exe);
+}
+
+/*
+    Keypad index for a host key, -1 for keys that aren't mapped.
+    The hex keypad is laid over the left of a QWERTY keyboard:
+        1 2 3 C        1 2 3 4
+        4 5 6 D   <-   Q W E R
+        7 8 9 E        A S D F
+        A 0 B F        Z X C V
+*/
+static int keypad_index(SDL_Keycode key)
+{
+    switch (key)
+    {
+        case SDLK_1: return 0x1;
+        case SDLK_2: return 0x2;
+        case SDLK_3: return 0x3;
+        case SDLK_4: return 0xC;
+        case SDLK_q: return 0x4;
+        case SDLK_w: return 0x5;
+        case SDLK_e: return 0x6;
+        case SDLK_r: return 0xD;
+        case SDLK_a: return 0x7;
+        case SDLK_s: return 0x8;
+        case SDLK_d: return 0x9;
+        case SDLK_f: return 0xE;
+        case SDLK_z: return 0xA;
+        case SDLK_x: return 0x0;
+        case SDLK_c: return 0xB;
+        case SDLK_v: return 0xF;
+    }
+    return -1;
+}
+
+/*
+    The emulator runs on its own thread so a present waiting for vblank or a
+    slow compositor never holds up instructions. It owns the machine, the
+    rewind history, the movie and the producing side of audio and frames;
+    the window thread handles events, draws the newest published frame and
+    talks to the emulator only through the atomics below.
+*/
+typedef struct
+{
+    chip8_t* chip;
+    config_t* config;
+    frames_t* frames;
+    audio_t* audio;
+    movie_t* movie;
+    rewind_t* history;
+    trace_t* trace;         // the emulator thread traces into it, NULL when off
+    Uint32 frame_event;     // pushed to the window thread when a frame is published
+
+    uint16_t keys;          // keypad bits, written by the window thread
+    bool rewinding;         // written by the window thread
+    bool quit;              // written by the window thread
+    bool notified;          // a frame_event is queued that the window thread hasn't acted on
+    SDL_sem* wake;          // posted on every change above, the emulator sleeps on it when idle
+} emulator_t;
+
+static void publish(emulator_t* emu, const uint64_t read_at[16])
+{
+    frame_t* frame = back_frame(emu->frames);
+    memcpy(frame->display, emu->chip->display, sizeof(frame->display));
+    memcpy(frame->read_at, read_at, sizeof(frame->read_at));
+    publish_frame(emu->frames);
+    emu->chip->redraw = false;
+
+    // one event in flight is enough, the window thread always takes the newest frame
+    if (!__atomic_exchange_n(&emu->notified, true, __ATOMIC_ACQ_REL)) {
+        SDL_Event event = { .type = emu->frame_event };
+        SDL_PushEvent(&event);
+    }
+}
+
+static int emulate(void* data)
+{
+    emulator_t* emu = data;
+    chip8_t* chip = emu->chip;
+    const config_t* config = emu->config;
+
+    const Uint64 frequency = SDL_GetPerformanceFrequency();
+    const Uint64 frame_ticks = frequency / FRAME_RATE;
+    Uint64 next_frame = SDL_GetPerformanceCounter();   // when the frame being run is due
+
+    // recent worst of sampling input to publishing the frame, decays by 1/64 a frame
+    Uint64 work_ticks = 0;
+    // SDL_Delay is in whole milliseconds and may oversleep by about one
+    const Uint64 margin_ticks = frequency / 500;
+
+    uint16_t keys = 0;
+    uint64_t read_at[16] = { 0 };
+    publish(emu, read_at);
+    if (emu->trace) {
+        start_trace(emu->trace);
+    }
+
+    while (!__atomic_load_n(&emu->quit, __ATOMIC_ACQUIRE))
+    {
+        // input is sampled as late as possible: sleep until only the time
+        // the last frames needed to run is left before the frame is due
+        if (!config->turbo) {
+            const Uint64 sample_at = next_frame - work_ticks - margin_ticks;
+            const Uint64 now = SDL_GetPerformanceCounter();
+            if (now < sample_at) {
+                SDL_Delay((Uint32)((sample_at - now) * 1000 / frequency));
+            }
+        }
+        const Uint64 sampled = SDL_GetPerformanceCounter();
+
+        // only changes are applied, stepping back restores the keypad of the snapshot
+        const uint16_t down = __atomic_load_n(&emu->keys, __ATOMIC_ACQUIRE);
+        for (uint16_t changed = down ^ keys; changed; changed &= changed - 1)
+        {
+            const uint8_t k = __builtin_ctz(changed);
+            chip->keypad[k] = (down >> k) & 1;
+            read_at[k] = 0;
+        }
+        keys = down;
+        const bool rewinding = __atomic_load_n(&emu->rewinding, __ATOMIC_ACQUIRE);
+
+        if (emu->movie) {
+            record_frame(emu->movie, chip);
+        }
+        if (rewinding) {
+            // stays on the oldest frame once the history runs out
+            step_rewind(emu->history, chip);
+        } else {
+            // run one frame worth of instructions and tick the timers
+            run_frame(chip, config->ipf);
+            push_rewind(emu->history, chip);
+        }
+        audio_frame(emu->audio, chip);
+
+        stamp_key_reads(chip, read_at);
+
+        if (chip->redraw) {
+            publish(emu, read_at);
+            const Uint64 work = SDL_GetPerformanceCounter() - sampled;
+            work_ticks = work > work_ticks ? work : work_ticks - work_ticks / 64;
+        }
+
+        // stuck in an idle loop with the timers run out, only a key can change anything now
+        if (chip->idle != IDLE_NONE && !rewinding && chip->delay_timer == 0 && chip->sound_timer == 0) {
+            // wake-ups for changes this frame already saw are dropped first
+            while (SDL_SemTryWait(emu->wake) == 0) {}
+            if (__atomic_load_n(&emu->keys, __ATOMIC_ACQUIRE) == keys && !__atomic_load_n(&emu->rewinding, __ATOMIC_ACQUIRE)
+                && !__atomic_load_n(&emu->quit, __ATOMIC_ACQUIRE)) {
+                SDL_SemWait(emu->wake);
+            }
+            next_frame = SDL_GetPerformanceCounter();
+        } else if (!config->turbo) {
+            next_frame += frame_ticks;
+            const Uint64 after = SDL_GetPerformanceCounter();
+            if (after > next_frame + frame_ticks * 4) {
+                // fell far behind (debugger), don't try to catch up
+                next_frame = after + frame_ticks;
+            }
+        }
+    }
+    stop_trace();
+    return 0;
+}
+
+int main( int argc, char* args[] )
+{
+    // configure
+    config_t* config = calloc(1, sizeof(config_t));
+    config->scale_factor = 5;
+    config->ipf = INSTRUCTIONS_PER_FRAME;
+
+    const char* rom_name = "roms/IBM Logo.ch8";
+    const char* record_path = NULL;
+    uint32_t seed = 0;
+    bool measure_latency = false;
+    quirks_t quirks = QUIRKS_MODERN;
+    const char* trace_path = NULL;
+    bool debugging = false;
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(args[a], "--ipf") == 0 && a + 1 < argc) {
+            config->ipf = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--turbo") == 0) {
+            config->turbo = true;
+        } else if (strcmp(args[a], "--seed") == 0 && a + 1 < argc) {
+            seed = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--record") == 0 && a + 1 < argc) {
+            record_path = args[++a];
+        } else if (strcmp(args[a], "--latency") == 0) {
+            measure_latency = true;
+        } else if (strcmp(args[a], "--quirks") == 0 && a + 1 < argc) {
+            quirks = find_quirks(args[++a]);
+            if (quirks == QUIRKS_COUNT) {
+                fprintf(stderr, "Unknown quirk profile %s\n", args[a]);
+                return 1;
+            }
+        } else if (strcmp(args[a], "--trace") == 0 && a + 1 < argc) {
+            trace_path = args[++a];
+        } else if (strcmp(args[a], "--debug") == 0) {
+            debugging = true;
+        } else if (args[a][0] == '-') {
+            usage(args[0]);
+            return 1;
+        } else {
+            rom_name = args[a];
+        }
+    }
+    
+    // initialize the window
+    sdl_t* sdl = init_sdl(config);
+    if (!sdl) {
+        return 1;
+    }
+    
+    // beeps while sound_timer runs, the game still plays without an output device
+    audio_t* audio = init_audio(AUDIO_RATE);
+    if (!audio) {
+        return 1;
+    }
+    init_sdl_audio(sdl, audio);
+
+    // init ship and load rom
+    chip8_t* chip = init_chip(rom_name);
+    if (!chip) {
+        return 1;
+    }
+    if (seed != 0) {
+        chip->rng = seed;
+    }
+    chip->quirks = quirks;
+
+    // a movie is one continuous run, so rewinding is off while recording
+    movie_t* movie = record_path ? init_movie(chip->rng, config->ipf) : NULL;
+
+    // holding backspace steps back one frame per frame
+    rewind_t* history = init_rewind(REWIND_BYTES);
+    if (!history) {
+        return 1;
+    }
+
+    // keypad to screen timings, reported when the window closes
+    latency_t* latency = measure_latency ? init_latency() : NULL;
+
+    // every instruction run, for play-trace
+    FILE* trace_file = trace_path ? fopen(trace_path, "wb") : NULL;
+    if (trace_path && !trace_file) {
+        fprintf(stderr, "Failed to create %s\n", trace_path);
+        return 1;
+    }
+    trace_t* trace = trace_file ? init_trace(trace_file) : NULL;
+    if (trace_file && !trace) {
+        return 1;
+    }
+
+    SDL_Event event; 
+    bool quit = false;
+    fill_display(chip, true);
+
+    if (debugging) {
+        // commands from the terminal, all on this thread; the window shows the machine and takes the keypad
+        debugger_t* dbg = init_debugger(chip, config->ipf);
+        if (!dbg) {
+            return 1;
+        }
+        if (trace) {
+            start_trace(trace);
+        }
+        printf("help lists the commands, a click steps one instruction or stops a continue\n(chip8) ");
+        fflush(stdout);
+
+        debug_state_t state = DEBUG_STOPPED;
+        char line[128];
+        while( quit == false && state != DEBUG_QUIT )
+        {
+            // a frame's time while running, otherwise a short wait so the terminal is read promptly
+            if (SDL_WaitEventTimeout(&event, state == DEBUG_RUNNING ? 1000 / FRAME_RATE : 10)) {
+                do
+                {
+                    if (event.type == SDL_QUIT) {
+                        quit = true;
+                    } else if (event.type == SDL_KEYDOWN || event.type == SDL_KEYUP) {
+                        const int key = keypad_index(event.key.keysym.sym);
+                        if (key >= 0) {
+                            chip->keypad[key] = event.type == SDL_KEYDOWN;
+                        }
+                    } else if (event.type == SDL_MOUSEBUTTONDOWN) {
+                        if (state == DEBUG_RUNNING) {
+                            debug_interrupt(dbg, stdout);
+                            state = DEBUG_STOPPED;
+                        } else {
+                            debug_command(dbg, "step", stdout);
+                        }
+                        printf("(chip8) ");
+                        fflush(stdout);
+                    }
+                } while( SDL_PollEvent( &event ) );
+            }
+
+            // one frame of a continue, or a command once a whole line has been typed
+            struct pollfd terminal = { .fd = 0, .events = POLLIN };
+            const bool running = state == DEBUG_RUNNING;
+            if (running) {
+                state = debug_continue(dbg, stdout);
+            } else if (poll(&terminal, 1, 0) > 0) {
+                state = fgets(line, sizeof(line), stdin) ? debug_command(dbg, line, stdout) : DEBUG_QUIT;
+            }
+            if (state == DEBUG_STOPPED && (running || terminal.revents)) {
+                printf("(chip8) ");
+                fflush(stdout);
+            }
+            const uint32_t rows = changed_rows(sdl, chip->display);
+            if (rows) {
+                draw(sdl, chip->display, rows);
+            }
+        }
+        stop_trace();
+        close_debugger(dbg);
+    } else {
+        frames_t* frames = init_frames();
+        emulator_t emu = {
+            .chip = chip,
+            .config = config,
+            .frames = frames,
+            .audio = audio,
+            .movie = movie,
+            .history = history,
+            .trace = trace,
+            .frame_event = SDL_RegisterEvents(1),
+            .wake = SDL_CreateSemaphore(0),
+        };
+        if (!frames || emu.frame_event == (Uint32)-1 || !emu.wake) {
+            SDL_Log("Failed to start the emulator thread: %s\n", SDL_GetError());
+            return 1;
+        }
+        SDL_Thread* thread = SDL_CreateThread(emulate, "emulator", &emu);
+        if (!thread) {
+            SDL_Log("Failed to start the emulator thread: %s\n", SDL_GetError());
+            return 1;
+        }
+
+        uint16_t keys = 0;
+        uint64_t shown = 0;     // number of the frame last drawn
+        while( quit == false )
+        {
+            // sleeps until there is input or a new frame
+            if (!SDL_WaitEvent(&event)) {
+                break;
+            }
+            do
+            {
+                if( event.type == SDL_QUIT ) 
+                {
+                    quit = true;
+                }
+                else if( event.type == SDL_KEYDOWN || event.type == SDL_KEYUP )
+                {
+                    const bool down = event.type == SDL_KEYDOWN;
+                    const int key = keypad_index(event.key.keysym.sym);
+                    if (key >= 0) {
+                        // key repeats change nothing
+                        if (((keys >> key) & 1) != down) {
+                            if (latency) {
+                                latency_input(latency, key);
+                            }
+                            keys ^= 1 << key;
+                            __atomic_store_n(&emu.keys, keys, __ATOMIC_RELEASE);
+                            SDL_SemPost(emu.wake);
+                        }
+                    } else if (event.key.keysym.sym == SDLK_BACKSPACE) {
+                        __atomic_store_n(&emu.rewinding, down && !movie, __ATOMIC_RELEASE);
+                        SDL_SemPost(emu.wake);
+                    }
+                }
+            } while( SDL_PollEvent( &event ) );
+
+            // draw the newest frame, any published since the last draw are skipped
+            __atomic_store_n(&emu.notified, false, __ATOMIC_RELEASE);
+            const frame_t* frame = latest_frame(frames);
+            if (frame && frame->number != shown) {
+                shown = frame->number;
+                if (latency) {
+                    latency_reads(latency, frame->read_at);
+                }
+                const uint32_t rows = changed_rows(sdl, frame->display);
+                if (rows) {
+                    if (latency) {
+                        latency_redraw(latency);
+                    }
+                    draw(sdl, frame->display, rows);
+                    if (latency) {
+                        latency_present(latency);
+                    }
+                }
+            }
+        }
+
+        __atomic_store_n(&emu.quit, true, __ATOMIC_RELEASE);
+        SDL_SemPost(emu.wake);
+        SDL_WaitThread(thread, NULL);
+        SDL_DestroySemaphore(emu.wake);
+        close_frames(frames);
+    }
+
+    if (trace) {
+        close_trace(trace);
+        if (fclose(trace_file) != 0) {
+            fprintf(stderr, "Failed to write %s\n", trace_path);
+        }
+    }
+    close_rewind(history);
+    close_sdl(sdl);
+    close_audio(audio);
+    if (latency) {
+        print_latency(latency, stderr);
+        close_latency(latency);
+    }
+
+    if (movie) {
+        FILE* file = fopen(record_path, "wb");
+        if (!file) {
+            fprintf(stderr, "Failed to create movie %s\n", record_path);
+            return 1;
+        }
+        const bool written = write_movie(movie, file);
+        close_movie(movie);
+        if (fclose(file) != 0 || !written) {
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,190 @@
+#include "movie.h"
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+typedef struct
+{
+    uint32_t frame;
+    uint8_t key;
+    bool down;
+} event_t;
+
+struct movie
+{
+    uint32_t seed;
+    uint32_t ipf;
+    uint32_t frames;    // recorded so far, or the length of a loaded movie
+
+    event_t* events;
+    uint32_t count;
+    uint32_t capacity;
+
+    uint32_t frame;     // next frame to record or play
+    uint32_t cursor;    // next event to play
+    bool keys[16];      // keypad as of the last recorded frame
+};
+
+static const char magic[4] = { 'C', 'H', '8', 'M' };
+
+
+static void add_event(movie_t* movie, uint32_t frame, uint8_t key, bool down)
+{
+    if (movie->count == movie->capacity) {
+        movie->capacity = movie->capacity ? movie->capacity * 2 : 256;
+        movie->events = realloc(movie->events, movie->capacity * sizeof(event_t));
+    }
+    movie->events[movie->count++] = (event_t){ frame, key, down };
+}
+
+static void put32(FILE* file, uint32_t d)
+{
+    const uint8_t bytes[4] = { d, d >> 8, d >> 16, d >> 24 };
+    fwrite(bytes, sizeof(bytes), 1, file);
+}
+
+static bool get32(FILE* file, uint32_t* d)
+{
+    uint8_t bytes[4];
+    if (fread(bytes, sizeof(bytes), 1, file) != 1) return false;
+    *d = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+    return true;
+}
+
+
+movie_t* init_movie(uint32_t seed, uint32_t ipf)
+{
+    movie_t* movie = calloc(1, sizeof(movie_t));
+    movie->seed = seed;
+    movie->ipf = ipf;
+    return movie;
+}
+
+void record_frame(movie_t* movie, const chip8_t* chip)
+{
+    for (uint8_t k = 0; k < 16; k++)
+    {
+        if (chip->keypad[k] != movie->keys[k]) {
+            add_event(movie, movie->frame, k, chip->keypad[k]);
+            movie->keys[k] = chip->keypad[k];
+        }
+    }
+    movie->frames = ++movie->frame;
+}
+
+bool play_frame(movie_t* movie, chip8_t* chip)
+{
+    if (movie->frame >= movie->frames) {
+        return false;
+    }
+    while (movie->cursor < movie->count && movie->events[movie->cursor].frame == movie->frame)
+    {
+        const event_t* e = &movie->events[movie->cursor++];
+        chip->keypad[e->key] = e->down;
+    }
+    movie->frame++;
+    return true;
+}
+
+uint32_t movie_seed(const movie_t* movie)
+{
+    return movie->seed;
+}
+
+uint32_t movie_ipf(const movie_t* movie)
+{
+    return movie->ipf;
+}
+
+uint32_t movie_frames(const movie_t* movie)
+{
+    return movie->frames;
+}
+
+bool write_movie(const movie_t* movie, FILE* file)
+{
+    fwrite(magic, sizeof(magic), 1, file);
+    put32(file, MOVIE_VERSION);
+    put32(file, movie->seed);
+    put32(file, movie->ipf);
+    put32(file, movie->frames);
+    put32(file, movie->count);
+
+    uint32_t last = 0;
+    for (uint32_t n = 0; n < movie->count; n++)
+    {
+        const event_t* e = &movie->events[n];
+        uint32_t delta = e->frame - last;
+        last = e->frame;
+        while (delta >= 0x80)
+        {
+            fputc((delta & 0x7F) | 0x80, file);
+            delta >>= 7;
+        }
+        fputc(delta, file);
+        fputc(e->key | e->down << 7, file);
+    }
+
+    if (ferror(file)) {
+        fprintf(stderr, "Failed to write movie\n");
+        return false;
+    }
+    return true;
+}
+
+movie_t* read_movie(FILE* file)
+{
+    char header[4];
+    uint32_t version;
+    if (fread(header, sizeof(header), 1, file) != 1 || memcmp(header, magic, sizeof(magic)) != 0 || !get32(file, &version)) {
+        fprintf(stderr, "Not a movie file\n");
+        return NULL;
+    }
+    if (version != MOVIE_VERSION) {
+        fprintf(stderr, "Movie version %u is not supported, expected %u\n", version, MOVIE_VERSION);
+        return NULL;
+    }
+
+    uint32_t seed, ipf, frames, count;
+    if (!get32(file, &seed) || !get32(file, &ipf) || !get32(file, &frames) || !get32(file, &count)) {
+        fprintf(stderr, "Movie file is truncated\n");
+        return NULL;
+    }
+
+    movie_t* movie = init_movie(seed, ipf);
+    movie->frames = frames;
+
+    uint32_t frame = 0;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        uint32_t delta = 0;
+        int b;
+        uint8_t shift = 0;
+        do
+        {
+            b = fgetc(file);
+            delta |= (uint32_t)(b & 0x7F) << shift;
+            shift += 7;
+        } while (b != EOF && (b & 0x80) && shift < 32);
+        const int key = fgetc(file);
+        if (b == EOF || key == EOF) {
+            fprintf(stderr, "Movie file is truncated\n");
+            close_movie(movie);
+            return NULL;
+        }
+        frame += delta;
+        add_event(movie, frame, key & 0x0F, key >> 7);
+    }
+    return movie;
+}
+
+void close_movie(movie_t* movie)
+{
+    free(movie->events);
+    free(movie);
+}
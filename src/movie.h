@@ -0,0 +1,46 @@
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+// bumped whenever the file layout written by write_movie() changes
+#define MOVIE_VERSION 1
+
+/*
+    Input movie: every keypad change with the frame it happened on, plus the
+    rng seed and instructions per frame the run started with. Replaying one
+    from the same rom reproduces the run exactly.
+*/
+typedef struct movie movie_t;
+
+// empty movie for recording, seed and ipf are the run's starting values
+movie_t* init_movie(uint32_t seed, uint32_t ipf);
+
+// call before each frame: records keys that changed since the last frame
+void record_frame(movie_t* movie, const chip8_t* chip);
+
+// call before each frame: applies the keys recorded for it, false past the end
+bool play_frame(movie_t* movie, chip8_t* chip);
+
+// rng seed, instructions per frame and frame count of the movie
+uint32_t movie_seed(const movie_t* movie);
+uint32_t movie_ipf(const movie_t* movie);
+uint32_t movie_frames(const movie_t* movie);
+
+/*
+    "CH8M", version, seed, ipf, frames, event count (u32 little-endian), then
+    one event per key change: frames since the previous event as a varint
+    and a byte of key | down << 7. Both return false or NULL and print to
+    stderr on failure.
+*/
+bool write_movie(const movie_t* movie, FILE* file);
+movie_t* read_movie(FILE* file);
+
+void close_movie(movie_t* movie);
+
+#endif
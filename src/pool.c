@@ -0,0 +1,264 @@
+#include "pool.h"
+#include "chip8.h"
+#include "instructions.h"
+#include "roms.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+
+// instances a worker has not started yet, [lo, hi)
+typedef struct
+{
+    _Alignas(64) pthread_mutex_t lock;
+    uint32_t lo;
+    uint32_t hi;
+    pthread_t thread;
+    uint32_t id;
+    struct pool* pool;
+} worker_t;
+
+// a line of its own, so workers counting different instances don't share one
+typedef struct
+{
+    _Alignas(64) chip8_t* chip;
+    uint64_t executed;
+} instance_t;
+
+struct pool
+{
+    instance_t* instances;
+    uint32_t count;
+
+    worker_t* workers;
+    uint32_t threads;
+
+    // current job, published under lock
+    pthread_mutex_t lock;
+    pthread_cond_t start;
+    pthread_cond_t done;
+    uint64_t generation;
+    uint32_t running;
+    bool quit;
+    uint64_t frames;
+    uint32_t ipf;
+};
+
+
+static bool take_own(worker_t* w, uint32_t* n)
+{
+    pthread_mutex_lock(&w->lock);
+    const bool found = w->lo < w->hi;
+    if (found) *n = w->lo++;
+    pthread_mutex_unlock(&w->lock);
+    return found;
+}
+
+// moves the upper half of some other worker's range into ours
+static bool steal(worker_t* w)
+{
+    pool_t* pool = w->pool;
+    for (uint32_t k = 1; k < pool->threads; k++)
+    {
+        worker_t* victim = &pool->workers[(w->id + k) % pool->threads];
+
+        pthread_mutex_lock(&victim->lock);
+        const uint32_t left = victim->hi - victim->lo;
+        if (left == 0) {
+            pthread_mutex_unlock(&victim->lock);
+            continue;
+        }
+        const uint32_t mid = victim->hi - (left + 1) / 2;
+        const uint32_t hi = victim->hi;
+        victim->hi = mid;
+        pthread_mutex_unlock(&victim->lock);
+
+        pthread_mutex_lock(&w->lock);
+        w->lo = mid;
+        w->hi = hi;
+        pthread_mutex_unlock(&w->lock);
+        return true;
+    }
+    return false;
+}
+
+static void run_instance(pool_t* pool, uint32_t n)
+{
+    instance_t* instance = &pool->instances[n];
+    uint64_t executed = 0;
+    for (uint64_t f = 0; f < pool->frames; f++)
+    {
+        executed += run_frame(instance->chip, pool->ipf);
+    }
+    instance->executed += executed;
+}
+
+static void* worker_main(void* arg)
+{
+    worker_t* w = arg;
+    pool_t* pool = w->pool;
+    uint64_t seen = 0;
+
+    for (;;)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (pool->generation == seen && !pool->quit)
+        {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        seen = pool->generation;
+        const bool quit = pool->quit;
+        pthread_mutex_unlock(&pool->lock);
+        if (quit) break;
+
+        uint32_t n;
+        while (take_own(w, &n) || (steal(w) && take_own(w, &n)))
+        {
+            run_instance(pool, n);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+
+pool_t* init_pool(const char* rom_name, uint32_t instances, uint32_t threads)
+{
+    if (threads == 0) {
+        const long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cores > 0 ? cores : 1;
+    }
+    if (threads > instances) threads = instances > 0 ? instances : 1;
+
+    pool_t* pool = calloc(1, sizeof(pool_t));
+    if (!pool) {
+        fprintf(stderr, "Not enough memory for %u instances\n", instances);
+        return NULL;
+    }
+    pool->instances = aligned_alloc(64, sizeof(instance_t) * (instances ? instances : 1));
+    pool->workers = aligned_alloc(64, sizeof(worker_t) * threads);
+    if (!pool->instances || !pool->workers) {
+        fprintf(stderr, "Not enough memory for %u instances\n", instances);
+        close_pool(pool);
+        return NULL;
+    }
+    memset(pool->instances, 0, sizeof(instance_t) * instances);
+    pool->count = instances;
+
+    // looked up once, every instance starts from the same image
+    const rom_t* rom = load_rom(shared_roms(), rom_name);
+    if (!rom) {
+        close_pool(pool);
+        return NULL;
+    }
+    for (uint32_t n = 0; n < instances; n++)
+    {
+        chip8_t* chip = init_chip_from_memory(rom->data, rom->size);
+        if (!chip) {
+            close_pool(pool);
+            return NULL;
+        }
+        // distinct Cxkk sequences per instance, xorshift needs a non-zero state
+        chip->rng += n;
+        if (chip->rng == 0) chip->rng = 1;
+        pool->instances[n].chip = chip;
+    }
+    pool->threads = threads;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (uint32_t t = 0; t < threads; t++)
+    {
+        worker_t* w = &pool->workers[t];
+        memset(w, 0, sizeof(worker_t));
+        pthread_mutex_init(&w->lock, NULL);
+        w->id = t;
+        w->pool = pool;
+        pthread_create(&w->thread, NULL, worker_main, w);
+    }
+    return pool;
+}
+
+chip8_t* pool_instance(pool_t* pool, uint32_t n)
+{
+    return pool->instances[n].chip;
+}
+
+uint32_t pool_threads(pool_t* pool)
+{
+    return pool->threads;
+}
+
+void run_pool(pool_t* pool, uint64_t frames, uint32_t ipf)
+{
+    pthread_mutex_lock(&pool->lock);
+
+    // hand every worker an equal share up front, stealing evens out the rest
+    for (uint32_t t = 0; t < pool->threads; t++)
+    {
+        worker_t* w = &pool->workers[t];
+        pthread_mutex_lock(&w->lock);
+        w->lo = (uint64_t)pool->count * t / pool->threads;
+        w->hi = (uint64_t)pool->count * (t + 1) / pool->threads;
+        pthread_mutex_unlock(&w->lock);
+    }
+
+    pool->frames = frames;
+    pool->ipf = ipf;
+    pool->running = pool->threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+
+    while (pool->running > 0)
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_result(pool_t* pool, uint32_t n, instance_result_t* result)
+{
+    chip8_t* chip = pool->instances[n].chip;
+    result->display_hash = hash_display(chip);
+    result->instructions = pool->instances[n].executed;
+    memcpy(result->v, chip->v, sizeof(result->v));
+    result->i = chip->i;
+    result->pc = chip->pc;
+}
+
+void close_pool(pool_t* pool)
+{
+    if (pool->threads > 0) {
+        pthread_mutex_lock(&pool->lock);
+        pool->quit = true;
+        pthread_cond_broadcast(&pool->start);
+        pthread_mutex_unlock(&pool->lock);
+
+        for (uint32_t t = 0; t < pool->threads; t++)
+        {
+            pthread_join(pool->workers[t].thread, NULL);
+            pthread_mutex_destroy(&pool->workers[t].lock);
+        }
+        pthread_mutex_destroy(&pool->lock);
+        pthread_cond_destroy(&pool->start);
+        pthread_cond_destroy(&pool->done);
+    }
+
+    for (uint32_t n = 0; n < pool->count; n++)
+    {
+        free(pool->instances[n].chip);
+    }
+    free(pool->instances);
+    free(pool->workers);
+    free(pool);
+}
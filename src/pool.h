@@ -0,0 +1,40 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "chip8.h"
+
+#include <stdint.h>
+
+
+/*
+    Many independent machines stepped in parallel. Each worker thread owns
+    a range of instances and steals half of another worker's remaining range
+    when its own runs out.
+*/
+typedef struct pool pool_t;
+
+typedef struct
+{
+    uint64_t display_hash;
+    uint64_t instructions;  // executed since init_pool()
+    uint8_t v[16];
+    uint16_t i;
+    uint16_t pc;
+} instance_result_t;
+
+// threads = 0 uses one thread per online core, instance n starts with rng seed base + n
+pool_t* init_pool(const char* rom_name, uint32_t instances, uint32_t threads);
+
+// direct access to an instance, e.g. to set keys before run_pool()
+chip8_t* pool_instance(pool_t* pool, uint32_t n);
+
+// runs every instance for frames 60 Hz frames of ipf instructions, returns when all are done
+void run_pool(pool_t* pool, uint64_t frames, uint32_t ipf);
+
+void pool_result(pool_t* pool, uint32_t n, instance_result_t* result);
+
+uint32_t pool_threads(pool_t* pool);
+
+void close_pool(pool_t* pool);
+
+#endif
@@ -0,0 +1,142 @@
+#include "profile.h"
+#include "chip8.h"
+#include "instructions.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+
+_Thread_local profile_t* active_profile;
+
+static const char* const names[OP_COUNT] = {
+    [OP_NONE]       = "-",
+    [OP_CLS]        = "CLS",
+    [OP_RET]        = "RET",
+    [OP_SYS]        = "SYS",
+    [OP_JP]         = "JP",
+    [OP_CALL]       = "CALL",
+    [OP_SE_VX_KK]   = "SE Vx, byte",
+    [OP_SNE_VX_KK]  = "SNE Vx, byte",
+    [OP_SE_VX_VY]   = "SE Vx, Vy",
+    [OP_LD_VX_KK]   = "LD Vx, byte",
+    [OP_ADD_VX_KK]  = "ADD Vx, byte",
+    [OP_LD_VX_VY]   = "LD Vx, Vy",
+    [OP_OR]         = "OR",
+    [OP_AND]        = "AND",
+    [OP_XOR]        = "XOR",
+    [OP_ADD_VX_VY]  = "ADD Vx, Vy",
+    [OP_SUB]        = "SUB",
+    [OP_SHR]        = "SHR",
+    [OP_SUBN]       = "SUBN",
+    [OP_SHL]        = "SHL",
+    [OP_SNE_VX_VY]  = "SNE Vx, Vy",
+    [OP_LD_I]       = "LD I, addr",
+    [OP_JP_V0]      = "JP V0, addr",
+    [OP_RND]        = "RND",
+    [OP_DRW]        = "DRW",
+    [OP_SKP]        = "SKP",
+    [OP_SKNP]       = "SKNP",
+    [OP_LD_VX_DT]   = "LD Vx, DT",
+    [OP_LD_VX_K]    = "LD Vx, K",
+    [OP_LD_DT_VX]   = "LD DT, Vx",
+    [OP_LD_ST_VX]   = "LD ST, Vx",
+    [OP_ADD_I_VX]   = "ADD I, Vx",
+    [OP_LD_F_VX]    = "LD F, Vx",
+    [OP_LD_B_VX]    = "LD B, Vx",
+    [OP_LD_I_VX]    = "LD [I], Vx",
+    [OP_LD_VX_I]    = "LD Vx, [I]",
+    [OP_UNKNOWN]    = "unknown",
+};
+
+
+void start_profile(profile_t* profile)
+{
+    active_profile = profile;
+}
+
+void stop_profile()
+{
+    active_profile = NULL;
+}
+
+uint64_t profile_ticks()
+{
+    #if defined(__x86_64__)
+        return __builtin_ia32_rdtsc();
+    #else
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    #endif
+}
+
+const char* op_name(uint8_t op)
+{
+    return op < OP_COUNT ? names[op] : "?";
+}
+
+
+static const uint64_t* sort_keys;
+
+// descending by sort_keys[index]
+static int by_count(const void* a, const void* b)
+{
+    const uint64_t ka = sort_keys[*(const uint16_t*)a];
+    const uint64_t kb = sort_keys[*(const uint16_t*)b];
+    return ka < kb ? 1 : ka > kb ? -1 : 0;
+}
+
+void print_profile(const profile_t* profile, FILE* out, uint32_t top)
+{
+    uint64_t instructions = 0;
+    uint64_t ticks = 0;
+    for (uint8_t op = 0; op < OP_COUNT; op++)
+    {
+        instructions += profile->op_counts[op];
+        ticks += profile->op_ticks[op];
+    }
+    if (instructions == 0) {
+        fprintf(out, "profile: no instructions recorded\n");
+        return;
+    }
+
+    uint16_t order[4096];
+    for (uint16_t n = 0; n < 4096; n++) order[n] = n;
+
+    fprintf(out, "profile: %llu instructions, %llu ticks\n", (unsigned long long)instructions, (unsigned long long)ticks);
+    fprintf(out, "%-14s %14s %7s %14s %7s %9s\n", "op", "count", "%", "ticks", "%", "ticks/op");
+    sort_keys = profile->op_counts;
+    qsort(order, OP_COUNT, sizeof(order[0]), by_count);
+    for (uint8_t n = 0; n < OP_COUNT && profile->op_counts[order[n]] > 0; n++)
+    {
+        const uint8_t op = order[n];
+        fprintf(out, "%-14s %14llu %6.2f%% %14llu %6.2f%% %9.1f\n", op_name(op),
+            (unsigned long long)profile->op_counts[op], 100.0 * profile->op_counts[op] / instructions,
+            (unsigned long long)profile->op_ticks[op], ticks ? 100.0 * profile->op_ticks[op] / ticks : 0.0,
+            (double)profile->op_ticks[op] / profile->op_counts[op]);
+    }
+
+    fprintf(out, "hot pcs:\n");
+    for (uint16_t n = 0; n < 4096; n++) order[n] = n;
+    sort_keys = profile->pc_counts;
+    qsort(order, 4096, sizeof(order[0]), by_count);
+    for (uint32_t n = 0; n < top && n < 4096 && profile->pc_counts[order[n]] > 0; n++)
+    {
+        fprintf(out, "  %.3X %14llu %6.2f%%\n", order[n],
+            (unsigned long long)profile->pc_counts[order[n]], 100.0 * profile->pc_counts[order[n]] / instructions);
+    }
+
+    const uint64_t draw = profile->op_ticks[OP_DRW];
+    fprintf(out, "Dxyn: %llu ticks (%.2f%%), everything else: %llu ticks (%.2f%%)\n",
+        (unsigned long long)draw, ticks ? 100.0 * draw / ticks : 0.0,
+        (unsigned long long)(ticks - draw), ticks ? 100.0 * (ticks - draw) / ticks : 0.0);
+    fprintf(out, "Dxyn ticks per execution:\n");
+    for (uint8_t b = 0; b < DRAW_BUCKETS; b++)
+    {
+        if (profile->draw_ticks[b] == 0) continue;
+        fprintf(out, "  %10llu-%-10llu %14llu\n",
+            b ? 1ULL << b : 0ULL, (2ULL << b) - 1, (unsigned long long)profile->draw_ticks[b]);
+    }
+}
@@ -0,0 +1,43 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "chip8.h"
+#include "instructions.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+
+#define DRAW_BUCKETS 32
+
+/*
+    Interpreter profile. While one is active on a thread, run_instructions()
+    on that thread dispatches through a table whose every entry counts the
+    instruction first, otherwise the only cost is choosing the table once
+    per call. Ticks are TSC cycles on x86-64 and nanoseconds elsewhere, each
+    instruction is charged the ticks until the next one starts.
+*/
+typedef struct
+{
+    uint64_t op_counts[OP_COUNT];
+    uint64_t op_ticks[OP_COUNT];
+    uint64_t pc_counts[4096];
+    uint64_t draw_ticks[DRAW_BUCKETS];  // Dxyn executions by log2 of their ticks
+} profile_t;
+
+// the profile run_instructions() on this thread is recording into, NULL when off
+extern _Thread_local profile_t* active_profile;
+
+// counts into profile until stop_profile(), nothing is reset
+void start_profile(profile_t* profile);
+void stop_profile();
+
+uint64_t profile_ticks();
+
+// mnemonic of a dispatch index, e.g. "DRW" for OP_DRW
+const char* op_name(uint8_t op);
+
+// op classes by count, the top hot pcs, and Dxyn ticks against everything else
+void print_profile(const profile_t* profile, FILE* out, uint32_t top);
+
+#endif
@@ -0,0 +1,208 @@
+#include "rewind.h"
+#include "chip8.h"
+#include "state.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+// a delta never encodes larger than this, see encode_delta()
+#define MAX_ENCODED (2 * sizeof(state_t) + 16)
+
+/*
+    Ring records are [u32 length][delta][u32 length]: the leading length
+    lets the oldest record be dropped, the trailing one lets step_rewind()
+    walk back from the newest.
+*/
+struct rewind
+{
+    uint8_t* ring;
+    size_t size;
+    size_t head;    // one past the newest record
+    size_t tail;    // start of the oldest record
+    size_t used;
+    uint32_t deltas;
+
+    bool have_current;
+    state_t current;    // newest snapshot
+    state_t next;       // scratch for push_rewind(), padding stays zero so it never shows up in a delta
+    uint8_t encoded[MAX_ENCODED];
+};
+
+
+static void ring_write(rewind_t* r, size_t pos, const void* src, size_t n)
+{
+    pos %= r->size;
+    const size_t first = n < r->size - pos ? n : r->size - pos;
+    memcpy(&r->ring[pos], src, first);
+    memcpy(&r->ring[0], (const uint8_t*)src + first, n - first);
+}
+
+static void ring_read(const rewind_t* r, size_t pos, void* dst, size_t n)
+{
+    pos %= r->size;
+    const size_t first = n < r->size - pos ? n : r->size - pos;
+    memcpy(dst, &r->ring[pos], first);
+    memcpy((uint8_t*)dst + first, &r->ring[0], n - first);
+}
+
+static void put_varint(uint8_t** p, uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        *(*p)++ = value | 0x80;
+        value >>= 7;
+    }
+    *(*p)++ = value;
+}
+
+static uint32_t get_varint(const uint8_t** p)
+{
+    uint32_t value = 0;
+    for (uint8_t shift = 0; ; shift += 7)
+    {
+        const uint8_t b = *(*p)++;
+        value |= (uint32_t)(b & 0x7F) << shift;
+        if (!(b & 0x80)) return value;
+    }
+}
+
+/*
+    Encodes a ^ b as runs of [zero bytes to skip][literal count][literals].
+    Gaps of fewer than 4 zero bytes stay inside a literal run, a new run
+    header would cost about as much.
+*/
+static size_t encode_delta(const uint8_t* a, const uint8_t* b, size_t n, uint8_t* out)
+{
+    uint8_t* p = out;
+    size_t i = 0;
+    while (i < n)
+    {
+        const size_t start = i;
+        uint64_t wa, wb;
+        while (i + 8 <= n && (memcpy(&wa, a + i, 8), memcpy(&wb, b + i, 8), wa == wb)) i += 8;
+        while (i < n && a[i] == b[i]) i++;
+        const size_t literal = i;
+        while (i < n)
+        {
+            if (a[i] != b[i]) {
+                i++;
+            } else if (i + 4 <= n && a[i + 1] == b[i + 1] && a[i + 2] == b[i + 2] && a[i + 3] == b[i + 3]) {
+                break;
+            } else if (i + 4 > n && memcmp(a + i, b + i, n - i) == 0) {
+                break;
+            } else {
+                i++;
+            }
+        }
+        put_varint(&p, literal - start);
+        put_varint(&p, i - literal);
+        for (size_t k = literal; k < i; k++) *p++ = a[k] ^ b[k];
+    }
+    return p - out;
+}
+
+// XORs an encoded delta into state
+static void apply_delta(uint8_t* state, size_t n, const uint8_t* in)
+{
+    size_t i = 0;
+    while (i < n)
+    {
+        i += get_varint(&in);
+        const uint32_t count = get_varint(&in);
+        for (uint32_t k = 0; k < count; k++) state[i++] ^= *in++;
+    }
+}
+
+static void drop_oldest(rewind_t* r)
+{
+    uint32_t length;
+    ring_read(r, r->tail, &length, sizeof(length));
+    r->tail = (r->tail + length + 8) % r->size;
+    r->used -= length + 8;
+    r->deltas--;
+}
+
+
+rewind_t* init_rewind(size_t bytes)
+{
+    rewind_t* r = calloc(1, sizeof(rewind_t));
+    r->ring = malloc(bytes);
+    if (!r->ring || bytes == 0) {
+        fprintf(stderr, "Failed to allocate %zu bytes of rewind history\n", bytes);
+        free(r->ring);
+        free(r);
+        return NULL;
+    }
+    r->size = bytes;
+    return r;
+}
+
+void push_rewind(rewind_t* r, const chip8_t* chip)
+{
+    if (!r->have_current) {
+        save_state(chip, &r->current);
+        r->have_current = true;
+        return;
+    }
+
+    save_state(chip, &r->next);
+    // the delta takes the new snapshot back to the current one
+    const uint32_t length = encode_delta((const uint8_t*)&r->current, (const uint8_t*)&r->next, sizeof(state_t), r->encoded);
+    const size_t record = length + 8;
+
+    if (record > r->size) {
+        // a ring this small holds no history
+        r->head = r->tail = r->used = 0;
+        r->deltas = 0;
+    } else {
+        while (r->size - r->used < record) drop_oldest(r);
+        ring_write(r, r->head, &length, sizeof(length));
+        ring_write(r, r->head + 4, r->encoded, length);
+        ring_write(r, r->head + 4 + length, &length, sizeof(length));
+        r->head = (r->head + record) % r->size;
+        r->used += record;
+        r->deltas++;
+    }
+    memcpy(&r->current, &r->next, sizeof(state_t));
+}
+
+bool step_rewind(rewind_t* r, chip8_t* chip)
+{
+    if (r->deltas == 0) {
+        return false;
+    }
+
+    uint32_t length;
+    const size_t end = r->head + r->size;
+    ring_read(r, end - 4, &length, sizeof(length));
+    ring_read(r, end - 4 - length, r->encoded, length);
+    apply_delta((uint8_t*)&r->current, sizeof(state_t), r->encoded);
+
+    r->head = (end - length - 8) % r->size;
+    r->used -= length + 8;
+    r->deltas--;
+
+    load_state(chip, &r->current);
+    return true;
+}
+
+uint32_t rewind_frames(const rewind_t* r)
+{
+    return r->have_current + r->deltas;
+}
+
+size_t rewind_used(const rewind_t* r)
+{
+    return r->used;
+}
+
+void close_rewind(rewind_t* r)
+{
+    free(r->ring);
+    free(r);
+}
@@ -0,0 +1,38 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+// default history size, minutes of typical play at 60 Hz
+#define REWIND_BYTES (4 << 20)
+
+/*
+    Rewind history in a fixed-size ring buffer. The newest snapshot is kept
+    whole, older ones as run-length encoded XOR deltas against the snapshot
+    after them, so stepping back is one decode and one load_state(). The
+    oldest deltas are dropped when the ring is full.
+*/
+typedef struct rewind rewind_t;
+
+rewind_t* init_rewind(size_t bytes);
+
+// records the machine as the newest snapshot, call once per frame
+void push_rewind(rewind_t* rewind, const chip8_t* chip);
+
+// restores the snapshot before the newest one, false when there is no older one
+bool step_rewind(rewind_t* rewind, chip8_t* chip);
+
+// snapshots held, the newest included
+uint32_t rewind_frames(const rewind_t* rewind);
+
+// bytes of the ring in use
+size_t rewind_used(const rewind_t* rewind);
+
+void close_rewind(rewind_t* rewind);
+
+#endif
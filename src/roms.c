@@ -0,0 +1,378 @@
+#include "roms.h"
+#include "chip8.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// what the file at a path was when it was read, so a changed file is read again
+typedef struct
+{
+    bool exists;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+} stamp_t;
+
+typedef struct
+{
+    rom_t rom;
+    bool owned;         // loaded from a file: name and data were allocated
+    bool stale;         // the file at name has changed since, only its hash still finds it
+    stamp_t stamp;
+} entry_t;
+
+// another path that resolved to a rom already in the library
+typedef struct
+{
+    char* key;          // "" once the file at it has changed
+    const rom_t* rom;
+    stamp_t stamp;      // of the file at key, exists is false when key resolved some other way
+} alias_t;
+
+struct rom_library
+{
+    pthread_mutex_t lock;
+
+    entry_t** entries;  // entries never move, load_rom() hands out pointers into them
+    uint32_t count;
+    uint32_t capacity;
+
+    uint32_t* by_hash;  // open addressing on rom hash, entry index + 1, 0 when free
+    uint32_t slots;     // power of two, at least twice count
+
+    alias_t* aliases;
+    uint32_t alias_count;
+    uint32_t alias_capacity;
+};
+
+
+uint64_t hash_rom(const uint8_t* data, size_t size)
+{
+    // FNV-1a, like hash_display()
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t n = 0; n < size; n++)
+    {
+        hash ^= data[n];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void stamp_stat(const struct stat* st, stamp_t* stamp)
+{
+    stamp->exists = true;
+    stamp->dev = st->st_dev;
+    stamp->ino = st->st_ino;
+    stamp->size = st->st_size;
+#if defined(__APPLE__)
+    stamp->mtime = st->st_mtimespec;
+#else
+    stamp->mtime = st->st_mtim;
+#endif
+}
+
+static void stamp_file(const char* path, stamp_t* stamp)
+{
+    struct stat st;
+    memset(stamp, 0, sizeof(*stamp));
+    if (stat(path, &st) == 0) {
+        stamp_stat(&st, stamp);
+    }
+}
+
+static bool same_stamp(const stamp_t* a, const stamp_t* b)
+{
+    return a->exists == b->exists && a->dev == b->dev && a->ino == b->ino && a->size == b->size
+        && a->mtime.tv_sec == b->mtime.tv_sec && a->mtime.tv_nsec == b->mtime.tv_nsec;
+}
+
+static const char* file_name(const char* path)
+{
+    const char* slash = strrchr(path, '/');
+    return slash ? slash + 1 : path;
+}
+
+static const rom_t* find_locked(const rom_library_t* library, uint64_t hash)
+{
+    if (library->slots == 0) return NULL;
+    for (uint32_t s = hash & (library->slots - 1); library->by_hash[s]; s = (s + 1) & (library->slots - 1))
+    {
+        const rom_t* rom = &library->entries[library->by_hash[s] - 1]->rom;
+        if (rom->hash == hash) return rom;
+    }
+    return NULL;
+}
+
+static void index_entry(rom_library_t* library, uint32_t n)
+{
+    uint32_t s = library->entries[n]->rom.hash & (library->slots - 1);
+    while (library->by_hash[s]) s = (s + 1) & (library->slots - 1);
+    library->by_hash[s] = n + 1;
+}
+
+static const rom_t* add_entry(rom_library_t* library, const rom_t* rom, bool owned, const stamp_t* stamp)
+{
+    if (library->count == library->capacity) {
+        library->capacity = library->capacity ? library->capacity * 2 : 64;
+        library->entries = realloc(library->entries, library->capacity * sizeof(entry_t*));
+    }
+    if ((library->count + 1) * 2 > library->slots) {
+        free(library->by_hash);
+        library->slots = library->slots ? library->slots * 2 : 128;
+        library->by_hash = calloc(library->slots, sizeof(uint32_t));
+        for (uint32_t n = 0; n < library->count; n++) index_entry(library, n);
+    }
+
+    entry_t* entry = malloc(sizeof(entry_t));
+    entry->rom = *rom;
+    entry->owned = owned;
+    entry->stale = false;
+    if (stamp) {
+        entry->stamp = *stamp;
+    } else {
+        memset(&entry->stamp, 0, sizeof(entry->stamp));
+    }
+    library->entries[library->count] = entry;
+    index_entry(library, library->count++);
+    return &entry->rom;
+}
+
+static void add_alias(rom_library_t* library, const char* key, const rom_t* rom, const stamp_t* stamp)
+{
+    if (library->alias_count == library->alias_capacity) {
+        library->alias_capacity = library->alias_capacity ? library->alias_capacity * 2 : 64;
+        library->aliases = realloc(library->aliases, library->alias_capacity * sizeof(alias_t));
+    }
+    library->aliases[library->alias_count++] = (alias_t){ strdup(key), rom, *stamp };
+}
+
+/*
+    Reads the file at path and adds it, or returns the rom with the same
+    contents already in the library. *missing is set when there's no file,
+    other failures print to stderr. The contents are copied rather than
+    mapped, a file rewritten in place must not change a rom handed out.
+*/
+static const rom_t* read_file(rom_library_t* library, const char* path, bool* missing, bool* added)
+{
+    *missing = false;
+    *added = false;
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        *missing = true;
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fprintf(stderr, "Failed to load rom file %s\n", path);
+        close(fd);
+        return NULL;
+    }
+    if (st.st_size > MAX_ROM_SIZE) {
+        fprintf(stderr, "Rom file %s is too big! Rom size: %lld, max allowed: %d.\n", path, (long long)st.st_size, MAX_ROM_SIZE);
+        close(fd);
+        return NULL;
+    }
+
+    stamp_t stamp;
+    stamp_stat(&st, &stamp);
+
+    rom_t rom = { path, NULL, st.st_size, 0 };
+    if (rom.size > 0) {
+        uint8_t* data = malloc(rom.size);
+        if (!data || read(fd, data, rom.size) != (ssize_t)rom.size) {
+            fprintf(stderr, "Failed to read rom file %s\n", path);
+            free(data);
+            close(fd);
+            return NULL;
+        }
+        rom.data = data;
+    }
+    close(fd);
+    rom.hash = hash_rom(rom.data, rom.size);
+
+    const rom_t* same = find_locked(library, rom.hash);
+    if (same && same->size == rom.size && (rom.size == 0 || memcmp(same->data, rom.data, rom.size) == 0)) {
+        free((void*)rom.data);
+        return same;
+    }
+    rom.name = strdup(path);
+    *added = true;
+    return add_entry(library, &rom, true, &stamp);
+}
+
+/*
+    A rom already in the library answering to key. With now, the stamp of
+    the file at key, a path whose file has changed since it was read is
+    forgotten and answers nothing, so the caller reads it again.
+*/
+static const rom_t* lookup(rom_library_t* library, const char* key, bool by_file_name, const stamp_t* now)
+{
+    for (uint32_t n = 0; n < library->alias_count; n++)
+    {
+        alias_t* alias = &library->aliases[n];
+        if (alias->key[0] == '\0' || strcmp(alias->key, key) != 0) continue;
+        if (now && !same_stamp(&alias->stamp, now)) {
+            alias->key[0] = '\0';
+            return NULL;
+        }
+        return alias->rom;
+    }
+    for (uint32_t n = 0; n < library->count; n++)
+    {
+        entry_t* entry = library->entries[n];
+        const rom_t* rom = &entry->rom;
+        if (!entry->stale && strcmp(rom->name, key) == 0) {
+            if (now && entry->owned && !same_stamp(&entry->stamp, now)) {
+                entry->stale = true;
+                return NULL;
+            }
+            return rom;
+        }
+        if (by_file_name && strcmp(file_name(rom->name), file_name(key)) == 0) return rom;
+    }
+
+    if (by_file_name && strlen(key) == 16 && strspn(key, "0123456789abcdefABCDEF") == 16) {
+        return find_locked(library, strtoull(key, NULL, 16));
+    }
+    return NULL;
+}
+
+
+rom_library_t* init_rom_library()
+{
+    rom_library_t* library = calloc(1, sizeof(rom_library_t));
+    if (!library) {
+        return NULL;
+    }
+    pthread_mutex_init(&library->lock, NULL);
+    for (uint32_t n = 0; n < embedded_rom_count; n++)
+    {
+        add_entry(library, &embedded_roms[n], false, NULL);
+    }
+    return library;
+}
+
+uint32_t add_rom_dir(rom_library_t* library, const char* dir)
+{
+    DIR* d = opendir(dir);
+    if (!d) {
+        fprintf(stderr, "Failed to open rom directory %s\n", dir);
+        return 0;
+    }
+
+    uint32_t added = 0;
+    char path[4096];
+    pthread_mutex_lock(&library->lock);
+    for (struct dirent* e; (e = readdir(d)) != NULL; )
+    {
+        snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+        struct stat st;
+        // anything that can't be a rom is left out quietly
+        if (e->d_name[0] == '.' || stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size > MAX_ROM_SIZE) {
+            continue;
+        }
+        stamp_t now;
+        stamp_file(path, &now);
+        if (lookup(library, path, false, &now)) continue;
+
+        bool missing, is_new;
+        const rom_t* rom = read_file(library, path, &missing, &is_new);
+        if (rom && !is_new) {
+            add_alias(library, path, rom, &now);
+        }
+        added += is_new;
+    }
+    pthread_mutex_unlock(&library->lock);
+    closedir(d);
+    return added;
+}
+
+const rom_t* load_rom(rom_library_t* library, const char* key)
+{
+    stamp_t now;
+    stamp_file(key, &now);
+    pthread_mutex_lock(&library->lock);
+    const rom_t* rom = lookup(library, key, false, &now);
+    if (!rom) {
+        bool missing, added;
+        rom = read_file(library, key, &missing, &added);
+        if (missing) {
+            rom = lookup(library, key, true, NULL);
+            if (!rom) {
+                fprintf(stderr, "Failed to load rom file %s\n", key);
+            }
+        }
+        // the next load of key is a lookup, whichever way it resolved
+        if (rom && !added) {
+            add_alias(library, key, rom, &now);
+        }
+    }
+    pthread_mutex_unlock(&library->lock);
+    return rom;
+}
+
+const rom_t* find_rom(const rom_library_t* library, uint64_t hash)
+{
+    pthread_mutex_lock((pthread_mutex_t*)&library->lock);
+    const rom_t* rom = find_locked(library, hash);
+    pthread_mutex_unlock((pthread_mutex_t*)&library->lock);
+    return rom;
+}
+
+uint32_t rom_count(const rom_library_t* library)
+{
+    return library->count;
+}
+
+const rom_t* rom_at(const rom_library_t* library, uint32_t n)
+{
+    return n < library->count ? &library->entries[n]->rom : NULL;
+}
+
+void close_rom_library(rom_library_t* library)
+{
+    for (uint32_t n = 0; n < library->count; n++)
+    {
+        entry_t* entry = library->entries[n];
+        if (entry->owned) {
+            free((void*)entry->rom.data);
+            free((char*)entry->rom.name);
+        }
+        free(entry);
+    }
+    for (uint32_t n = 0; n < library->alias_count; n++)
+    {
+        free(library->aliases[n].key);
+    }
+    pthread_mutex_destroy(&library->lock);
+    free(library->aliases);
+    free(library->by_hash);
+    free(library->entries);
+    free(library);
+}
+
+
+static rom_library_t* shared;
+static pthread_once_t shared_once = PTHREAD_ONCE_INIT;
+
+static void init_shared()
+{
+    shared = init_rom_library();
+}
+
+rom_library_t* shared_roms()
+{
+    pthread_once(&shared_once, init_shared);
+    return shared;
+}
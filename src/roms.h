@@ -0,0 +1,58 @@
+#ifndef ROMS_H
+#define ROMS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+/*
+    Rom library. Files are read once and indexed by path, file name and
+    FNV-1a hash of their contents, so loading the same rom again, under
+    any path, costs a lookup and a stat() of the path. A path whose file
+    has changed since (device, inode, size or modification time) is read
+    again; roms already handed out keep their contents. Roms compiled into
+    the binary (embedded_roms, see embedded.c) are indexed from the start
+    and serve a path whose file name matches even when the file isn't there.
+*/
+typedef struct
+{
+    const char* name;       // path it was loaded from, or file name when embedded
+    const uint8_t* data;
+    size_t size;
+    uint64_t hash;          // hash_rom() of data
+} rom_t;
+
+typedef struct rom_library rom_library_t;
+
+// roms compiled in by play-embed
+extern const rom_t embedded_roms[];
+extern const uint32_t embedded_rom_count;
+
+uint64_t hash_rom(const uint8_t* data, size_t size);
+
+// library holding the embedded roms
+rom_library_t* init_rom_library();
+
+// reads every file in dir small enough to be a rom, returns how many were new
+uint32_t add_rom_dir(rom_library_t* library, const char* dir);
+
+/*
+    The rom for key: a path loaded before, a file name or 16 hex digit
+    content hash of any rom in the library, else the file at that path,
+    read and added. NULL and stderr when none of them exist.
+*/
+const rom_t* load_rom(rom_library_t* library, const char* key);
+
+// NULL when no rom has these contents
+const rom_t* find_rom(const rom_library_t* library, uint64_t hash);
+
+uint32_t rom_count(const rom_library_t* library);
+const rom_t* rom_at(const rom_library_t* library, uint32_t n);
+
+void close_rom_library(rom_library_t* library);
+
+// the process-wide library init_chip() loads through, created on first use
+rom_library_t* shared_roms();
+
+#endif
@@ -0,0 +1,167 @@
+#include "state.h"
+#include "chip8.h"
+#include "instructions.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+// granularity load_state() compares memory at, matches chip8_t.written_pages
+#define PAGE_SIZE 64
+
+static const char magic[4] = { 'C', 'H', '8', 'S' };
+
+
+void save_state(const chip8_t* chip, state_t* state)
+{
+    memcpy(state->memory, chip->memory, sizeof(state->memory));
+    memcpy(state->display, chip->display, sizeof(state->display));
+    memcpy(state->stack, chip->stack, sizeof(state->stack));
+    state->sp = chip->sp;
+    memcpy(state->v, chip->v, sizeof(state->v));
+    state->i = chip->i;
+    state->pc = chip->pc;
+    state->delay_timer = chip->delay_timer;
+    state->sound_timer = chip->sound_timer;
+    memcpy(state->keypad, chip->keypad, sizeof(state->keypad));
+    state->rng = chip->rng;
+}
+
+void load_state(chip8_t* chip, const state_t* state)
+{
+    // pages with the same bytes keep their decoded (and translated) code
+    for (uint16_t page = 0; page < sizeof(chip->memory); page += PAGE_SIZE)
+    {
+        if (memcmp(&chip->memory[page], &state->memory[page], PAGE_SIZE) != 0) {
+            memcpy(&chip->memory[page], &state->memory[page], PAGE_SIZE);
+            invalidate_decoded(chip, page, PAGE_SIZE);
+        }
+    }
+
+    memcpy(chip->display, state->display, sizeof(chip->display));
+    memcpy(chip->stack, state->stack, sizeof(chip->stack));
+    chip->sp = state->sp < 12 ? state->sp : 11;
+    memcpy(chip->v, state->v, sizeof(chip->v));
+    chip->i = state->i;
+    chip->pc = state->pc;
+    chip->delay_timer = state->delay_timer;
+    chip->sound_timer = state->sound_timer;
+    memcpy(chip->keypad, state->keypad, sizeof(chip->keypad));
+    chip->rng = state->rng;
+
+    chip->redraw = true;
+}
+
+
+static void put16(uint8_t** p, uint16_t w)
+{
+    *(*p)++ = w;
+    *(*p)++ = w >> 8;
+}
+
+static void put32(uint8_t** p, uint32_t d)
+{
+    put16(p, d);
+    put16(p, d >> 16);
+}
+
+static void put64(uint8_t** p, uint64_t q)
+{
+    put32(p, q);
+    put32(p, q >> 32);
+}
+
+static uint16_t get16(const uint8_t** p)
+{
+    const uint16_t w = (*p)[0] | (*p)[1] << 8;
+    *p += 2;
+    return w;
+}
+
+static uint32_t get32(const uint8_t** p)
+{
+    const uint32_t lo = get16(p);
+    return lo | (uint32_t)get16(p) << 16;
+}
+
+static uint64_t get64(const uint8_t** p)
+{
+    const uint64_t lo = get32(p);
+    return lo | (uint64_t)get32(p) << 32;
+}
+
+// bytes of a version 1 file, header included
+#define STATE_FILE_SIZE (4 + 4 + 4096 + HEIGHT * 8 + 12 * 2 + 1 + 16 + 2 + 2 + 1 + 1 + 16 + 4)
+
+bool write_state(const state_t* state, FILE* file)
+{
+    uint8_t buffer[STATE_FILE_SIZE];
+    uint8_t* p = buffer;
+
+    memcpy(p, magic, sizeof(magic));
+    p += sizeof(magic);
+    put32(&p, STATE_VERSION);
+
+    memcpy(p, state->memory, sizeof(state->memory));
+    p += sizeof(state->memory);
+    for (uint8_t y = 0; y < HEIGHT; y++) put64(&p, state->display[y]);
+    for (uint8_t s = 0; s < 12; s++) put16(&p, state->stack[s]);
+    *p++ = state->sp;
+    memcpy(p, state->v, sizeof(state->v));
+    p += sizeof(state->v);
+    put16(&p, state->i);
+    put16(&p, state->pc);
+    *p++ = state->delay_timer;
+    *p++ = state->sound_timer;
+    for (uint8_t k = 0; k < 16; k++) *p++ = state->keypad[k];
+    put32(&p, state->rng);
+
+    if (fwrite(buffer, sizeof(buffer), 1, file) != 1) {
+        fprintf(stderr, "Failed to write save state\n");
+        return false;
+    }
+    return true;
+}
+
+bool read_state(state_t* state, FILE* file)
+{
+    uint8_t buffer[STATE_FILE_SIZE];
+    const uint8_t* p = buffer;
+
+    if (fread(buffer, 8, 1, file) != 1 || memcmp(buffer, magic, sizeof(magic)) != 0) {
+        fprintf(stderr, "Not a save state file\n");
+        return false;
+    }
+    p += sizeof(magic);
+    const uint32_t version = get32(&p);
+    if (version != STATE_VERSION) {
+        fprintf(stderr, "Save state version %u is not supported, expected %u\n", version, STATE_VERSION);
+        return false;
+    }
+    if (fread(buffer + 8, sizeof(buffer) - 8, 1, file) != 1) {
+        fprintf(stderr, "Save state file is truncated\n");
+        return false;
+    }
+
+    memcpy(state->memory, p, sizeof(state->memory));
+    p += sizeof(state->memory);
+    for (uint8_t y = 0; y < HEIGHT; y++) state->display[y] = get64(&p);
+    for (uint8_t s = 0; s < 12; s++) state->stack[s] = get16(&p);
+    state->sp = *p++;
+    memcpy(state->v, p, sizeof(state->v));
+    p += sizeof(state->v);
+    state->i = get16(&p);
+    state->pc = get16(&p);
+    state->delay_timer = *p++;
+    state->sound_timer = *p++;
+    for (uint8_t k = 0; k < 16; k++) state->keypad[k] = *p++ != 0;
+    state->rng = get32(&p);
+
+    if (state->sp >= 12) {
+        fprintf(stderr, "Save state has a stack pointer out of range (%u)\n", state->sp);
+        return false;
+    }
+    return true;
+}
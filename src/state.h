@@ -0,0 +1,47 @@
+#ifndef STATE_H
+#define STATE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+// bumped whenever the file layout written by write_state() changes
+#define STATE_VERSION 1
+
+/*
+    Snapshot of everything the program can observe, the fields of chip8_t
+    up to rng. The decode cache is not saved and is
+    rebuilt by load_state().
+*/
+typedef struct
+{
+    uint8_t memory[4096];
+    uint64_t display[HEIGHT];
+    uint16_t stack[12];
+    uint8_t sp;
+    uint8_t v[16];
+    uint16_t i;
+    uint16_t pc;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    bool keypad[16];
+    uint32_t rng;
+} state_t;
+
+void save_state(const chip8_t* chip, state_t* state);
+
+// restores a snapshot, only memory pages that differ are copied and invalidated
+void load_state(chip8_t* chip, const state_t* state);
+
+/*
+    Versioned, little-endian file format so states move between hosts:
+    "CH8S", version (u32), then the state_t fields in declaration order.
+    Both return false and print to stderr on failure.
+*/
+bool write_state(const state_t* state, FILE* file);
+bool read_state(state_t* state, FILE* file);
+
+#endif
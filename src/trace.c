@@ -0,0 +1,650 @@
+#include "trace.h"
+#include "chip8.h"
+#include "instructions.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+
+// contexts the compressor predicts a word from, one per pc
+#define CONTEXTS 4096
+
+// the most a block's words compress to: a byte of lengths per pair and all 8 bytes of each
+#define BLOCK_BYTES (TRACE_WORDS / 2 + TRACE_WORDS * 8)
+
+// a word's context, its pc plus the part of chip->decoded's address above bit 1
+#define CONTEXT(word) (((word) >> 50) & (CONTEXTS - 1))
+
+// top nibble of each op's opcode, x and kk are in its decoded_t
+static const uint8_t tops[OP_COUNT] = {
+    [OP_JP] = 0x1, [OP_CALL] = 0x2, [OP_SE_VX_KK] = 0x3, [OP_SNE_VX_KK] = 0x4, [OP_SE_VX_VY] = 0x5,
+    [OP_LD_VX_KK] = 0x6, [OP_ADD_VX_KK] = 0x7,
+    [OP_LD_VX_VY ... OP_SHL] = 0x8,
+    [OP_SNE_VX_VY] = 0x9, [OP_LD_I] = 0xA, [OP_JP_V0] = 0xB, [OP_RND] = 0xC, [OP_DRW] = 0xD,
+    [OP_SKP ... OP_SKNP] = 0xE,
+    [OP_LD_VX_DT ... OP_LD_VX_I] = 0xF,
+};
+
+// how long the writer sleeps when every ring is empty
+#define IDLE_NS 1000000
+
+_Thread_local trace_ring_t* active_trace;
+
+// per ring on either side: the word last seen after each pc and the pc of the last word
+typedef struct
+{
+    uint64_t predicted[CONTEXTS];
+    uint16_t context;
+} contexts_t;
+
+typedef struct node
+{
+    trace_ring_t* ring;
+    uint32_t number;
+    struct node* next;
+    contexts_t contexts;
+} node_t;
+
+struct trace
+{
+    FILE* file;
+    pthread_t writer;
+    pthread_mutex_t lock;   // guards rings
+    pthread_mutex_t idle_lock;
+    pthread_cond_t wake;    // signalled by a thread whose ring is full
+    node_t* rings;
+    uint32_t count;
+    bool closing;
+    bool failed;            // a write failed, reported once
+    uint64_t* words;        // a ring's words, copied out so the ring is free again before they're compressed
+    uint8_t* block;
+};
+
+struct trace_reader
+{
+    FILE* file;
+    uint8_t* block;
+    uint64_t* words;        // of the current block
+    uint32_t count;
+    uint32_t at;
+    uint32_t ring;
+    uint16_t decoded;       // low 16 bits of chip->decoded as of the last registers
+    uint8_t quirks;         // QUIRK_* flags as of the last registers
+    contexts_t** rings;     // by ring number, NULL until its first block
+    uint32_t ring_count;
+    trace_record_t last;
+};
+
+static const uint8_t magic[4] = { 'C', 'H', '8', 'T' };
+
+
+static void put32(uint8_t* bytes, uint32_t d)
+{
+    bytes[0] = d;
+    bytes[1] = d >> 8;
+    bytes[2] = d >> 16;
+    bytes[3] = d >> 24;
+}
+
+static uint32_t get32(const uint8_t* bytes)
+{
+    return bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+}
+
+// the file holds words little-endian
+static inline uint64_t little_endian(uint64_t word)
+{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap64(word);
+#else
+    return word;
+#endif
+}
+
+/*
+    Context of the word after word. V0 to VF after the registers or an
+    Fx65 are predicted at the odd contexts past theirs, which no
+    instruction at an even pc has, and the word after them at the one the
+    registers or Fx65 would have given it. rest counts them down.
+*/
+static inline uint16_t next_context(uint64_t word, uint16_t context, uint8_t* rest, uint16_t* after)
+{
+    if (*rest) {
+        return --*rest ? (context + 2) & (CONTEXTS - 1) : *after;
+    }
+    *after = CONTEXT(word);
+    const uint8_t op = word >> 16;
+    if (op == OP_NONE || op == OP_LD_VX_I) {
+        *rest = 2;
+        return (*after + 1) & (CONTEXTS - 1);
+    }
+    return *after;
+}
+
+/*
+    Stores count words to out as the file holds them and returns how many
+    bytes that took. Most words are the one seen after the same pc last
+    time, so XORed with it nothing is left, or the low byte of a value.
+*/
+static uint32_t compress(contexts_t* contexts, const uint64_t* words, uint64_t count, uint8_t* out)
+{
+    uint64_t* const predicted = contexts->predicted;
+    uint16_t context = contexts->context;
+    uint16_t after = context;
+    uint8_t rest = 0;
+    uint8_t* const start = out;
+    for (uint64_t n = 0; n < count; n += 2)
+    {
+        const uint64_t first = words[n];
+        const uint64_t first_change = first ^ predicted[context];
+        predicted[context] = first;
+        context = next_context(first, context, &rest, &after);
+
+        // an odd count's last byte of lengths has 0 for the word past it
+        uint64_t second_change = 0;
+        if (n + 1 < count) {
+            const uint64_t second = words[n + 1];
+            second_change = second ^ predicted[context];
+            predicted[context] = second;
+            context = next_context(second, context, &rest, &after);
+        }
+
+        // most pairs are what their pcs saw last time
+        if ((first_change | second_change) == 0) {
+            *out++ = 0;
+            continue;
+        }
+        const uint8_t first_length = first_change ? (71 - __builtin_clzll(first_change)) >> 3 : 0;
+        const uint8_t second_length = second_change ? (71 - __builtin_clzll(second_change)) >> 3 : 0;
+        *out++ = first_length | second_length << 4;
+        // all 8 bytes, the next word's overwrite those past length
+        const uint64_t stored[2] = { little_endian(first_change), little_endian(second_change) };
+        memcpy(out, &stored[0], sizeof(stored[0]));
+        out += first_length;
+        memcpy(out, &stored[1], sizeof(stored[1]));
+        out += second_length;
+    }
+    contexts->context = context;
+    return out - start;
+}
+
+// compress() undone, false when bytes run out before count words
+static bool expand(contexts_t* contexts, const uint8_t* in, uint32_t bytes, uint64_t* words, uint32_t count)
+{
+    uint64_t* const predicted = contexts->predicted;
+    uint16_t context = contexts->context;
+    uint16_t after = context;
+    uint8_t rest = 0;
+    uint32_t at = 0;
+    uint8_t lengths = 0;
+    for (uint32_t n = 0; n < count; n++)
+    {
+        if (!(n & 1)) {
+            if (at >= bytes) return false;
+            lengths = in[at++];
+        }
+        const uint8_t length = n & 1 ? lengths >> 4 : lengths & 0x0F;
+        if (length > 8 || length > bytes - at) return false;
+        uint64_t change = 0;
+        memcpy(&change, &in[at], length);
+        at += length;
+
+        const uint64_t word = little_endian(change) ^ predicted[context];
+        predicted[context] = word;
+        context = next_context(word, context, &rest, &after);
+        words[n] = word;
+    }
+    contexts->context = context;
+    return true;
+}
+
+// writes the ring's new words as one block, returns how many
+static uint64_t drain(trace_t* trace, node_t* node)
+{
+    trace_ring_t* ring = node->ring;
+    const uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    const uint64_t tail = ring->tail;
+    if (head == tail) return 0;
+
+    // copied out first, the traced thread may reuse the words as soon as they're taken
+    const uint64_t count = head - tail;
+    const uint64_t at = tail & (TRACE_WORDS - 1);
+    const uint64_t first = count < TRACE_WORDS - at ? count : TRACE_WORDS - at;
+    memcpy(trace->words, &ring->words[at], first * sizeof(uint64_t));
+    memcpy(trace->words + first, ring->words, (count - first) * sizeof(uint64_t));
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+
+    const uint32_t bytes = compress(&node->contexts, trace->words, count, trace->block + 12);
+    put32(trace->block, node->number);
+    put32(trace->block + 4, count);
+    put32(trace->block + 8, bytes);
+    if (fwrite(trace->block, 12 + bytes, 1, trace->file) != 1 && !trace->failed) {
+        fprintf(stderr, "Failed to write the trace, the rest is lost\n");
+        trace->failed = true;
+    }
+    return count;
+}
+
+/*
+    The registers after the instruction, worked out from those before it as
+    its handler does. Only RND, DRW, Fx07 and Fx0A have a value to take,
+    Fx65 has V0 to VF.
+*/
+static void apply(trace_record_t* record, uint8_t op, uint8_t quirks, uint16_t value, const uint8_t* v)
+{
+    const uint8_t x = (record->opcode >> 8) & 0x0F;
+    const uint8_t y = (record->opcode >> 4) & 0x0F;
+    const uint8_t kk = record->opcode;
+    uint8_t* const r = record->v;
+    switch (op)
+    {
+        case OP_RET:        if (record->sp > 0) record->sp--; break;
+        case OP_CALL:       if (record->sp < 11) record->sp++; break;
+        case OP_LD_VX_KK:   r[x] = kk; break;
+        case OP_ADD_VX_KK:  r[x] += kk; break;
+        case OP_LD_VX_VY:   r[x] = r[y]; break;
+        case OP_OR:         r[x] |= r[y]; if (quirks & QUIRK_VF_RESET) r[0xF] = 0; break;
+        case OP_AND:        r[x] &= r[y]; if (quirks & QUIRK_VF_RESET) r[0xF] = 0; break;
+        case OP_XOR:        r[x] ^= r[y]; if (quirks & QUIRK_VF_RESET) r[0xF] = 0; break;
+        case OP_ADD_VX_VY:
+        {
+            const uint16_t sum = r[x] + r[y];
+            r[x] = sum;
+            r[0xF] = sum > 0xFF;
+            break;
+        }
+        case OP_SUB:
+        {
+            const uint8_t not_borrow = r[x] >= r[y];
+            r[x] -= r[y];
+            r[0xF] = not_borrow;
+            break;
+        }
+        case OP_SUBN:
+        {
+            const uint8_t not_borrow = r[y] >= r[x];
+            r[x] = r[y] - r[x];
+            r[0xF] = not_borrow;
+            break;
+        }
+        case OP_SHR:
+        {
+            const uint8_t source = quirks & QUIRK_SHIFT_VY ? r[y] : r[x];
+            r[x] = source >> 1;
+            r[0xF] = source & 0x01;
+            break;
+        }
+        case OP_SHL:
+        {
+            const uint8_t source = quirks & QUIRK_SHIFT_VY ? r[y] : r[x];
+            r[x] = source << 1;
+            r[0xF] = source >> 7;
+            break;
+        }
+        case OP_LD_I:       record->i = record->opcode & 0x0FFF; break;
+        case OP_RND:        r[x] = value; break;
+        case OP_DRW:        r[0xF] = value; break;
+        case OP_LD_VX_DT:   r[x] = record->delay_timer = value; break;
+        case OP_LD_VX_K:    r[x] = value; break;
+        case OP_LD_DT_VX:   record->delay_timer = r[x]; break;
+        case OP_ADD_I_VX:   record->i += r[x]; break;
+        case OP_LD_F_VX:    record->i = (r[x] & 0x0F) * 5; break;
+        case OP_LD_I_VX:    if (quirks & QUIRK_LOAD_STORE_I) record->i += x + 1; break;
+        case OP_LD_VX_I:
+        {
+            memcpy(r, v, x + 1);
+            if (quirks & QUIRK_LOAD_STORE_I) record->i += x + 1;
+            break;
+        }
+    }
+}
+
+static void* write_trace(void* data)
+{
+    trace_t* trace = data;
+    for (;;)
+    {
+        // read first, so the rings are drained once more after closing is set
+        const bool closing = __atomic_load_n(&trace->closing, __ATOMIC_ACQUIRE);
+        uint64_t taken = 0;
+        pthread_mutex_lock(&trace->lock);
+        for (node_t* node = trace->rings; node; node = node->next)
+        {
+            taken += drain(trace, node);
+        }
+        pthread_mutex_unlock(&trace->lock);
+        if (taken == 0) {
+            if (closing) break;
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += IDLE_NS;
+            if (until.tv_nsec >= 1000000000) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000;
+            }
+            pthread_mutex_lock(&trace->idle_lock);
+            pthread_cond_timedwait(&trace->wake, &trace->idle_lock, &until);
+            pthread_mutex_unlock(&trace->idle_lock);
+        }
+    }
+    return NULL;
+}
+
+static size_t append(char* line, size_t size, size_t n, const char* format, ...)
+{
+    if (n >= size) return n;
+    va_list args;
+    va_start(args, format);
+    const int written = vsnprintf(line + n, size - n, format, args);
+    va_end(args);
+    return written > 0 ? n + written : n;
+}
+
+
+trace_t* init_trace(FILE* file)
+{
+    trace_t* trace = calloc(1, sizeof(trace_t));
+    uint64_t* words = malloc(TRACE_WORDS * sizeof(uint64_t));
+    uint8_t* block = malloc(12 + BLOCK_BYTES);
+    if (!trace || !words || !block) {
+        fprintf(stderr, "Not enough memory to trace\n");
+        free(trace);
+        free(words);
+        free(block);
+        return NULL;
+    }
+    uint8_t header[12];
+    memcpy(header, magic, sizeof(magic));
+    put32(header + 4, TRACE_VERSION);
+    put32(header + 8, CONTEXTS);
+    if (fwrite(header, sizeof(header), 1, file) != 1) {
+        fprintf(stderr, "Failed to start the trace\n");
+        free(trace);
+        free(words);
+        free(block);
+        return NULL;
+    }
+    trace->file = file;
+    trace->words = words;
+    trace->block = block;
+    pthread_mutex_init(&trace->lock, NULL);
+    pthread_mutex_init(&trace->idle_lock, NULL);
+    pthread_cond_init(&trace->wake, NULL);
+    pthread_create(&trace->writer, NULL, write_trace, trace);
+    return trace;
+}
+
+bool start_trace(trace_t* trace)
+{
+    node_t* node = calloc(1, sizeof(node_t));
+    trace_ring_t* ring = aligned_alloc(64, sizeof(trace_ring_t));
+    if (!node || !ring) {
+        fprintf(stderr, "Not enough memory to trace\n");
+        free(node);
+        free(ring);
+        return false;
+    }
+    ring->out = ring->end = ring->words;
+    ring->written = ring->head = ring->tail = 0;
+    ring->trace = trace;
+    node->ring = ring;
+
+    pthread_mutex_lock(&trace->lock);
+    node->number = trace->count++;
+    node->next = trace->rings;
+    trace->rings = node;
+    pthread_mutex_unlock(&trace->lock);
+
+    active_trace = ring;
+    return true;
+}
+
+void stop_trace()
+{
+    if (active_trace) {
+        publish_trace(active_trace, active_trace->out);
+    }
+    active_trace = NULL;
+}
+
+void close_trace(trace_t* trace)
+{
+    __atomic_store_n(&trace->closing, true, __ATOMIC_RELEASE);
+    pthread_join(trace->writer, NULL);
+    fflush(trace->file);
+
+    for (node_t* node = trace->rings; node; )
+    {
+        node_t* next = node->next;
+        free(node->ring);
+        free(node);
+        node = next;
+    }
+    pthread_mutex_destroy(&trace->lock);
+    pthread_mutex_destroy(&trace->idle_lock);
+    pthread_cond_destroy(&trace->wake);
+    free(trace->words);
+    free(trace->block);
+    free(trace);
+}
+
+void publish_trace(trace_ring_t* ring, uint64_t* out)
+{
+    uint64_t* const words = ring->words;
+    ring->written += out - ring->out;
+    // an instruction's words past the end of the ring belong at its start
+    if (out > &words[TRACE_WORDS]) {
+        memcpy(words, &words[TRACE_WORDS], (out - &words[TRACE_WORDS]) * sizeof(uint64_t));
+    }
+    ring->out = &words[ring->written & (TRACE_WORDS - 1)];
+    __atomic_store_n(&ring->head, ring->written, __ATOMIC_RELEASE);
+}
+
+uint64_t* flush_trace(trace_ring_t* ring, uint64_t* out, const chip8_t* chip)
+{
+    publish_trace(ring, out);
+    // room for the registers and the longest instruction
+    uint64_t room = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) + TRACE_WORDS - ring->written;
+    if (room < 6) {
+        // the writer may be asleep, the ring filled faster than it looks
+        pthread_mutex_lock(&ring->trace->idle_lock);
+        pthread_cond_signal(&ring->trace->wake);
+        pthread_mutex_unlock(&ring->trace->idle_lock);
+        while ((room = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) + TRACE_WORDS - ring->written) < 6)
+        {
+            sched_yield();
+        }
+    }
+
+    uint64_t* const words = ring->words;
+    uint64_t registers[2];
+    memcpy(registers, chip->v, sizeof(registers));
+    words[ring->written++ & (TRACE_WORDS - 1)] = chip->i | (uint64_t)OP_NONE << 16 | (uint64_t)chip->sp << 24
+        | (uint64_t)chip->delay_timer << 32 | (uint64_t)quirk_flags(chip->quirks) << 40
+        | (uint64_t)(uintptr_t)chip->decoded << 48;
+    words[ring->written++ & (TRACE_WORDS - 1)] = registers[0];
+    words[ring->written++ & (TRACE_WORDS - 1)] = registers[1];
+    room -= 3;
+
+    // the last instruction started before end may write 3 words, up to 2 into the slack past the ring
+    const uint64_t at = ring->written & (TRACE_WORDS - 1);
+    uint64_t ahead = room - 2 < TRACE_PUBLISH ? room - 2 : TRACE_PUBLISH;
+    if (ahead > TRACE_WORDS - at) ahead = TRACE_WORDS - at;
+    ring->out = &words[at];
+    ring->end = &words[at + ahead];
+    return ring->out;
+}
+
+
+trace_reader_t* init_trace_reader(FILE* file)
+{
+    uint8_t header[12];
+    if (fread(header, sizeof(header), 1, file) != 1 || memcmp(header, magic, sizeof(magic)) != 0) {
+        fprintf(stderr, "Not a trace\n");
+        return NULL;
+    }
+    if (get32(header + 4) != TRACE_VERSION || get32(header + 8) != CONTEXTS) {
+        fprintf(stderr, "Unsupported trace version %u\n", get32(header + 4));
+        return NULL;
+    }
+    trace_reader_t* reader = calloc(1, sizeof(trace_reader_t));
+    uint8_t* block = malloc(BLOCK_BYTES);
+    uint64_t* words = malloc(TRACE_WORDS * sizeof(uint64_t));
+    if (!reader || !block || !words) {
+        fprintf(stderr, "Not enough memory to trace\n");
+        free(reader);
+        free(block);
+        free(words);
+        return NULL;
+    }
+    reader->file = file;
+    reader->block = block;
+    reader->words = words;
+    return reader;
+}
+
+// the contexts of ring number ring, started on its first block; NULL and stderr when out of memory
+static contexts_t* ring_contexts(trace_reader_t* reader, uint32_t ring)
+{
+    if (ring >= reader->ring_count) {
+        const uint32_t count = ring + 1 > reader->ring_count * 2 ? ring + 1 : reader->ring_count * 2;
+        contexts_t** rings = realloc(reader->rings, count * sizeof(contexts_t*));
+        if (!rings) {
+            fprintf(stderr, "Not enough memory to trace\n");
+            return NULL;
+        }
+        memset(rings + reader->ring_count, 0, (count - reader->ring_count) * sizeof(contexts_t*));
+        reader->rings = rings;
+        reader->ring_count = count;
+    }
+    if (!reader->rings[ring]) {
+        reader->rings[ring] = calloc(1, sizeof(contexts_t));
+        if (!reader->rings[ring]) fprintf(stderr, "Not enough memory to trace\n");
+    }
+    return reader->rings[ring];
+}
+
+// the next block's words, false at the end or on a damaged block
+static bool read_block(trace_reader_t* reader)
+{
+    uint8_t header[12];
+    if (fread(header, sizeof(header), 1, reader->file) != 1) return false;
+    const uint32_t ring = get32(header);
+    const uint32_t count = get32(header + 4);
+    const uint32_t bytes = get32(header + 8);
+    // a thread per ring, no trace has anywhere near this many
+    if (ring > 0xFFFF || count > TRACE_WORDS || bytes > BLOCK_BYTES || fread(reader->block, 1, bytes, reader->file) != bytes) {
+        fprintf(stderr, "Trace block is damaged\n");
+        return false;
+    }
+    contexts_t* contexts = ring_contexts(reader, ring);
+    if (!contexts) return false;
+    if (!expand(contexts, reader->block, bytes, reader->words, count)) {
+        fprintf(stderr, "Trace block is damaged\n");
+        return false;
+    }
+    reader->ring = ring;
+    reader->count = count;
+    reader->at = 0;
+    memset(&reader->last, 0, sizeof(reader->last));
+    return true;
+}
+
+bool read_record(trace_reader_t* reader, trace_record_t* record, uint32_t* ring)
+{
+    trace_record_t* last = &reader->last;
+    for (;;)
+    {
+        if (reader->at == reader->count) {
+            if (!read_block(reader)) {
+                reader->at = reader->count = 0;
+                return false;
+            }
+            continue;
+        }
+
+        const uint64_t* word = &reader->words[reader->at];
+        const uint8_t op = word[0] >> 16;
+        // the registers and an Fx65 are 3 words
+        const bool wide = op == OP_NONE || op == OP_LD_VX_I;
+        if (wide && reader->count - reader->at < 3) {
+            fprintf(stderr, "Trace block is damaged\n");
+            reader->at = reader->count = 0;
+            return false;
+        }
+        reader->at += wide ? 3 : 1;
+
+        uint8_t v[16];
+        if (wide) memcpy(v, &word[1], sizeof(v));
+        if (op == OP_NONE) {
+            last->i = word[0];
+            last->sp = word[0] >> 24;
+            last->delay_timer = word[0] >> 32;
+            reader->quirks = word[0] >> 40;
+            reader->decoded = word[0] >> 48;
+            memcpy(last->v, v, sizeof(v));
+            continue;
+        }
+        if (op >= OP_COUNT) {
+            fprintf(stderr, "Trace block is damaged\n");
+            reader->at = reader->count = 0;
+            return false;
+        }
+        const uint8_t x = word[0] >> 24;
+        const uint8_t kk = word[0] >> 40;
+        last->pc = (uint16_t)((word[0] >> 48) - reader->decoded) >> 2 & 0x0FFF;
+        // one that isn't an instruction has its opcode for a value
+        last->opcode = op == OP_UNKNOWN ? (uint16_t)word[0] : tops[op] << 12 | (x & 0x0F) << 8 | kk;
+        apply(last, op, reader->quirks, word[0], v);
+
+        *record = *last;
+        *ring = reader->ring;
+        return true;
+    }
+}
+
+void close_trace_reader(trace_reader_t* reader)
+{
+    for (uint32_t r = 0; r < reader->ring_count; r++)
+    {
+        free(reader->rings[r]);
+    }
+    free(reader->rings);
+    free(reader->words);
+    free(reader->block);
+    free(reader);
+}
+
+void format_record(const trace_record_t* previous, const trace_record_t* record, char* line, size_t size)
+{
+    size_t n = append(line, size, 0, "%.3X: %.4X ", record->pc, record->opcode);
+    if (!previous || previous->i != record->i) n = append(line, size, n, " I=%.3X", record->i);
+    for (uint8_t r = 0; r < 16; r++)
+    {
+        if (!previous || previous->v[r] != record->v[r]) n = append(line, size, n, " V%X=%.2X", r, record->v[r]);
+    }
+    if (!previous || previous->delay_timer != record->delay_timer) n = append(line, size, n, " DT=%.2X", record->delay_timer);
+    if (!previous || previous->sp != record->sp) n = append(line, size, n, " SP=%X", record->sp);
+
+    // Fx33 and Fx55 store from I as the record before left it
+    if (!previous) return;
+    const uint8_t x = (record->opcode >> 8) & 0x0F;
+    if ((record->opcode & 0xF0FF) == 0xF033) {
+        const uint8_t value = record->v[x];
+        n = append(line, size, n, " [%.3X]=%.2X %.2X %.2X", previous->i, value / 100, value / 10 % 10, value % 10);
+    } else if ((record->opcode & 0xF0FF) == 0xF055) {
+        n = append(line, size, n, " [%.3X]=", previous->i);
+        for (uint8_t r = 0; r <= x; r++)
+        {
+            n = append(line, size, n, r ? " %.2X" : "%.2X", record->v[r]);
+        }
+    }
+}
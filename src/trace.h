@@ -0,0 +1,138 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "chip8.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+
+// bumped whenever the file layout written by the trace writer changes
+#define TRACE_VERSION 3
+
+// words per ring, a power of two
+#define TRACE_WORDS 65536
+
+// words the traced thread writes before making them visible to the writer
+#define TRACE_PUBLISH 1024
+
+/*
+    Execution trace. While one is started on a thread, run_instructions() on
+    that thread runs a copy of the interpreter where every handler appends a
+    word to the thread's ring (a profile, profile.h, wins over a trace). A
+    writer thread copies what each ring holds out of it and compresses the
+    copy into the file. Only the interpreter traces, the jit and aot run
+    untraced.
+
+    The word is what the instruction wrote that the reader can't work out
+    from the registers before it, its decoded_t and the low 16 bits of that
+    decoded_t's address (trace_word()), which is what the handler has at
+    hand. The value is Vx after RND, Fx07 or Fx0A, VF after DRW, the opcode
+    for one that isn't an instruction and 0 for the rest. Fx65 adds two
+    words with V0 to VF. Whenever words are published, and at the start of
+    every run_instructions() call, the registers follow: a word of I, SP,
+    DT, the QUIRK_* flags and the low 16 bits of chip->decoded, with OP_NONE
+    where an instruction has its op, then V0 to VF. So a change made
+    between calls (timer ticks, load_state(), forks) reaches the trace too,
+    and the reader can turn addresses back into pcs. It replays every
+    instruction on these to rebuild the registers after it; the delay timer
+    is as of the last registers, Fx07 or Fx15.
+
+    Memory writes aren't stored, they follow from the opcode, the I of the
+    record before and the registers: format_record() prints them.
+*/
+typedef struct
+{
+    uint16_t pc;
+    uint16_t opcode;
+    uint16_t i;             // this and everything below as the instruction left them
+    uint8_t sp;
+    uint8_t delay_timer;
+    uint8_t v[16];
+} trace_record_t;
+
+typedef struct trace trace_t;
+
+// one thread's words on their way to the writer, single producer and single consumer
+typedef struct trace_ring
+{
+    uint64_t* out;          // where the traced thread writes next, kept in a register while run_instructions() runs
+    uint64_t* end;          // it calls flush_trace() once out reaches this
+    uint64_t written;       // words before out
+    trace_t* trace;
+    _Alignas(64) uint64_t head;     // words visible to the writer
+    _Alignas(64) uint64_t tail;     // words the writer has taken
+    _Alignas(64) uint64_t words[TRACE_WORDS + 2];  // an Fx65 starting in the last word runs 2 past it
+} trace_ring_t;
+
+// the ring run_instructions() on this thread is tracing into, NULL when off
+extern _Thread_local trace_ring_t* active_trace;
+
+// starts the writer on file, which stays the caller's to close after close_trace()
+trace_t* init_trace(FILE* file);
+
+// traces this thread into trace until stop_trace(), false when out of memory
+bool start_trace(trace_t* trace);
+void stop_trace();
+
+// waits for the writer to drain every ring, after every thread tracing into it has stopped
+void close_trace(trace_t* trace);
+
+// counts the words written up to out and lets the writer see them
+void publish_trace(trace_ring_t* ring, uint64_t* out);
+
+/*
+    Publishes up to out, waits for the writer when the ring is full, then
+    appends chip's registers. Returns where the next word goes, ring->end
+    says how far words may go before calling it again. Called between
+    instructions, before the first and once out reaches ring->end.
+*/
+uint64_t* flush_trace(trace_ring_t* ring, uint64_t* out, const chip8_t* chip);
+
+// an instruction's word, the value low where the compressor looks for changes first
+static inline uint64_t trace_word(const decoded_t* d, uint16_t value)
+{
+    uint32_t fields;
+    memcpy(&fields, d, sizeof(fields));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // op in the low byte either way
+    fields = __builtin_bswap32(fields);
+#endif
+    return value | (uint64_t)fields << 16 | (uint64_t)(uintptr_t)d << 48;
+}
+
+
+/*
+    "CH8T", version and the number of contexts (u32 little-endian), then
+    blocks of one ring's words: the ring's number, word count and byte count
+    (u32), then per pair of words a byte holding the length of each in its
+    low and high nibble, each followed by that many low bytes of the word
+    XORed with the one last seen in its context, little-endian. The rest of
+    those words is 0. A word's context is bits 50 to 61 of the word before
+    it, its pc while chip->decoded stays put; the two words of V0 to VF
+    after the registers or an Fx65 have that word's context plus 1 and 3,
+    and the word after them the one that word gives. Each ring's contexts
+    start at 0 and carry over from one of its blocks to the next, and every
+    block starts with the registers.
+*/
+typedef struct trace_reader trace_reader_t;
+
+// NULL and stderr when file isn't a trace
+trace_reader_t* init_trace_reader(FILE* file);
+
+// the next record and the number of the ring it came from, false at the end or on a damaged block
+bool read_record(trace_reader_t* reader, trace_record_t* record, uint32_t* ring);
+
+void close_trace_reader(trace_reader_t* reader);
+
+/*
+    "204: F155  I=300 V1=05 [300]=00 05", the record and what changed since
+    previous, the record before it on the same ring (NULL for the first,
+    which then prints every register).
+*/
+void format_record(const trace_record_t* previous, const trace_record_t* record, char* line, size_t size);
+
+#endif
@@ -0,0 +1,78 @@
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+
+/*
+    Prints a trace written by play-headless --trace or play --trace, one line
+    per instruction with what it changed. make trace builds it.
+
+    usage: play-trace [--ring N] [--limit N] file
+
+    --ring picks the thread to print in a trace of several, the first to
+    start tracing is ring 0 and the default. --limit stops after N lines.
+*/
+
+static void usage(const char* exe)
+{
+    fprintf(stderr, "usage: %s [--ring N] [--limit N] file\n", exe);
+}
+
+int main( int argc, char* args[] )
+{
+    const char* path = NULL;
+    uint32_t wanted = 0;
+    uint64_t limit = UINT64_MAX;
+
+    for (int a = 1; a < argc; a++)
+    {
+        if (strcmp(args[a], "--ring") == 0 && a + 1 < argc) {
+            wanted = strtoul(args[++a], NULL, 0);
+        } else if (strcmp(args[a], "--limit") == 0 && a + 1 < argc) {
+            limit = strtoull(args[++a], NULL, 0);
+        } else if (args[a][0] == '-' || path) {
+            usage(args[0]);
+            return 1;
+        } else {
+            path = args[a];
+        }
+    }
+    if (!path) {
+        usage(args[0]);
+        return 1;
+    }
+
+    FILE* file = fopen(path, "rb");
+    if (!file) {
+        fprintf(stderr, "Failed to open trace %s\n", path);
+        return 1;
+    }
+    trace_reader_t* reader = init_trace_reader(file);
+    if (!reader) {
+        fclose(file);
+        return 1;
+    }
+
+    trace_record_t previous;
+    trace_record_t record;
+    uint32_t ring;
+    bool first = true;
+    char line[160];
+    for (uint64_t printed = 0; printed < limit && read_record(reader, &record, &ring); )
+    {
+        if (ring != wanted) continue;
+        format_record(first ? NULL : &previous, &record, line, sizeof(line));
+        puts(line);
+        previous = record;
+        first = false;
+        printed++;
+    }
+
+    close_trace_reader(reader);
+    fclose(file);
+    return 0;
+}